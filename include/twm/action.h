@@ -0,0 +1,46 @@
+// This file was developed by Thomas Müller <thomas94@gmx.net>.
+// It is published under the GPU GPLv3 license; see LICENSE.txt for details.
+
+#pragma once
+
+#include <twm/common.h>
+
+#include <string>
+#include <string_view>
+
+namespace twm {
+
+enum class Action {
+	Focus,
+	Swap,
+	MoveToDesktop,
+	Close,
+	Terminate,
+	Reload,
+};
+
+Action to_action(std::string_view str);
+
+enum class Target {
+	Window,
+	Desktop,
+};
+
+Target to_target(std::string_view str);
+
+// An action string such as "focus window left", parsed and validated once
+// when the config is loaded, such that invoking it involves no string
+// processing. Fields that the action does not use keep their defaults.
+struct Command {
+	Action action = Action::Reload;
+	Target target = Target::Window;
+	Direction direction = Direction::Left;
+
+	// Of the desktop to focus, counting from 0 in the order of the task view, or -1 to focus by direction
+	int desktop_index = -1;
+};
+
+// Throws std::runtime_error if `str` is not a valid action.
+Command parse_command(std::string_view str);
+
+} // namespace twm
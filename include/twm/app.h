@@ -0,0 +1,146 @@
+// This file was developed by Thomas Müller <thomas94@gmx.net>.
+// It is published under the GPU GPLv3 license; see LICENSE.txt for details.
+
+#pragma once
+
+#include <twm/action.h>
+#include <twm/common.h>
+#include <twm/config.h>
+#include <twm/events.h>
+#include <twm/input.h>
+#include <twm/loop.h>
+
+#include <filesystem>
+#include <future>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace twm {
+
+// The first location that has a config file, see definition.
+std::optional<std::filesystem::path> find_config();
+
+// (Re-)loads the config from `find_config()`, or the default config if there is none.
+void reload();
+
+// Starts finding and parsing the config on another thread, such that startup can go on in the meantime. Yields
+// nullptr if there is no config file. Errors are thrown from `get()`.
+std::future<std::shared_ptr<const ParsedConfig>> parse_config_async();
+
+// Loads a parsed config, or the default config if `parsed` is nullptr.
+void load_config(std::shared_ptr<const ParsedConfig> parsed);
+void save_config_to_appdata();
+
+void invoke_action(const Command& cmd);
+
+// Applies all pending window events to the tracked desktops. `window_events` may be nullptr.
+void apply_window_events(WindowEventSource* window_events);
+
+// Keeps `Desktop::current_id()` up to date as the user switches desktops. `desktop_switches` may be nullptr,
+// in which case the current desktop keeps being inferred by `Desktop::update_all`. Must outlive `loop`.
+void track_current_desktop(EventLoop& loop, DesktopSwitchSource* desktop_switches);
+
+// Takes stock of all windows once the loop runs, unless a hotkey was served before and did so already. Window
+// events must be on by then, if they are available, such that they report every change from there on.
+void schedule_first_update(EventLoop& loop);
+
+// Periodically updates all desktops: rarely with window events, to reconcile
+// whatever they may have missed, and frequently without, in their place.
+void schedule_update(EventLoop& loop, bool has_window_events);
+
+// Reloads the config whenever its file changes. Watches the file's directory rather than the file itself, such
+// that editors that save by replacing the file are noticed, too. As a single save may consist of several writes,
+// changes are debounced into a single reload. The file is parsed and validated on a background thread, and the
+// config is only replaced, all at once, if all of it is valid. Costs nothing while the file does not change: there
+// is no polling.
+class ConfigWatcher {
+public:
+	// Throws if the file's directory can't be watched.
+	ConfigWatcher(EventLoop& loop, const std::filesystem::path& path);
+	~ConfigWatcher();
+
+	ConfigWatcher(const ConfigWatcher& other) = delete;
+	ConfigWatcher& operator=(const ConfigWatcher& other) = delete;
+
+	size_t n_reloads() const { return m_n_reloads; }
+
+private:
+	struct FileStamp {
+		std::filesystem::file_time_type time = {};
+		uintmax_t size = 0;
+
+		bool operator==(const FileStamp& other) const = default;
+	};
+
+	static FileStamp stamp(const std::filesystem::path& path);
+
+	void on_change();
+	void schedule_reload();
+	void parse();
+	void on_parsed(std::shared_ptr<const ParsedConfig> parsed, const std::string& error);
+
+	EventLoop& m_loop;
+	std::filesystem::path m_path;
+	FileStamp m_stamp;
+	std::unique_ptr<DirectoryChangeSource> m_source;
+
+	// The loop can't cancel what was scheduled or posted, so those check whether the watcher is still around.
+	std::shared_ptr<bool> m_alive = std::make_shared<bool>(true);
+
+	clock::time_point m_reload_time = {};
+	bool m_reload_scheduled = false;
+	bool m_parsing = false;
+	bool m_parse_again = false;
+	std::thread m_parser;
+
+	size_t m_n_reloads = 0;
+};
+
+// Serves the config's key sequences and modes (see input.h) through the loop, following reloads of the config.
+// Only hooks the keyboard while there are any, because the hook puts every key press of the system through twm.
+class KeySequences {
+public:
+	KeySequences(EventLoop& loop, WindowEventSource* window_events);
+	~KeySequences();
+
+	KeySequences(const KeySequences& other) = delete;
+	KeySequences& operator=(const KeySequences& other) = delete;
+
+	// Called whenever the config was (re-)loaded.
+	void update();
+
+	// The key sequences may be served before window events are on. `window_events` may be nullptr.
+	void set_window_events(WindowEventSource* window_events);
+
+private:
+	EventLoop& m_loop;
+	WindowEventSource* m_window_events;
+	std::unique_ptr<InputEngine> m_engine;
+};
+
+// Times the phases of startup, which are traced and, once twm is ready to serve hotkeys, logged. Also logs how long
+// it takes until the first hotkey is served. twm commonly starts at login, where every bit of delay is noticeable.
+class StartupTimeline {
+public:
+	StartupTimeline();
+
+	// Ends the phase that began when the previous one ended. Must be a string literal, see TraceEvent.
+	void end_phase(const char* name);
+
+	// Logs the phases. The first hotkey that `tick` serves from here on logs the time since startup.
+	void ready();
+
+private:
+	clock::time_point m_start;
+	clock::time_point m_phase_start;
+	std::vector<std::pair<const char*, clock::duration>> m_phases;
+};
+
+// Runs one iteration of the main loop. Returns false once twm should quit.
+bool tick(EventLoop& loop, WindowEventSource* window_events);
+
+} // namespace twm
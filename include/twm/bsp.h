@@ -0,0 +1,77 @@
+// This file was developed by Thomas Müller <thomas94@gmx.net>.
+// It is published under the GPU GPLv3 license; see LICENSE.txt for details.
+
+#pragma once
+
+#include <twm/common.h>
+#include <twm/math.h>
+
+#include <memory>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace twm {
+
+struct BspNode {
+	struct Children {
+		std::unique_ptr<BspNode> left, right;
+	};
+
+	std::variant<HWND, Children> payload;
+	BspNode* parent = nullptr;
+
+	// Inner nodes split their rect along `axis`, giving `ratio` of it to the left child.
+	size_t axis = 0;
+	float ratio = 0.5f;
+
+	// Target rect as of the last layout. Nodes that were never laid out are dirty.
+	Rect rect = {};
+	bool dirty = true;
+};
+
+// Binary space partitioning tree that tiles windows within a work area.
+// Layout is incremental: a mutation only recomputes the subtree that it
+// affects and reports just the windows whose target rect changed, such
+// that opening or closing a window does not move all the others.
+class BspTree {
+public:
+	using Changes = std::vector<std::pair<HWND, Rect>>;
+
+	BspTree(const Rect& work_area = {}) : m_work_area{work_area} {}
+
+	// Inserts the window by splitting the tile of `split_target` along its
+	// longer axis. Splits the last tile if `split_target` is not in the tree.
+	Changes insert(HWND handle, HWND split_target = nullptr);
+
+	// Removes the window. Its sibling subtree takes over the space.
+	Changes remove(HWND handle);
+
+	// Exchanges the tiles of two windows.
+	Changes swap(HWND a, HWND b);
+
+	// Sets the share of the split between the window and its sibling that goes to the window.
+	Changes set_ratio(HWND handle, float ratio);
+
+	Changes set_work_area(const Rect& work_area);
+	const Rect& work_area() const { return m_work_area; }
+
+	bool contains(HWND handle) const { return m_leaves.count(handle) > 0; }
+	std::optional<Rect> rect_of(HWND handle) const;
+
+	size_t size() const { return m_leaves.size(); }
+	bool empty() const { return m_leaves.empty(); }
+	void clear();
+
+private:
+	void layout(BspNode& node, const Rect& rect, Changes& changes, bool force = false);
+	std::unique_ptr<BspNode>& owner_of(BspNode& node);
+
+	std::unique_ptr<BspNode> m_root;
+	std::unordered_map<HWND, BspNode*> m_leaves;
+	Rect m_work_area;
+};
+
+} // namespace twm
@@ -7,13 +7,60 @@
 #include <functional>
 #include <sstream>
 #include <string>
+#include <string_view>
+#include <vector>
+
+#ifdef _WIN32
+#	define NOMINMAX
+#	include <ShlObj.h>
+#	include <Windows.h>
+#	ifdef far
+#		undef far
+#		undef near
+#	endif
+#else
+#	include <cstdint>
+
+// Stand-ins for the handful of Windows types and constants that the platform-independent core uses, such that
+// it can be built and benchmarked on other operating systems against the simulated platform (see platform.h).
+struct HWND__;
+using HWND = HWND__*;
+using HANDLE = void*;
+using UINT = unsigned int;
+using COLORREF = uint32_t;
+
+struct GUID {
+	uint32_t Data1;
+	uint16_t Data2;
+	uint16_t Data3;
+	uint8_t Data4[8];
+};
 
-#define NOMINMAX
-#include <ShlObj.h>
-#include <Windows.h>
-#ifdef far
-#	undef far
-#	undef near
+constexpr UINT MOD_ALT = 0x0001;
+constexpr UINT MOD_CONTROL = 0x0002;
+constexpr UINT MOD_SHIFT = 0x0004;
+constexpr UINT MOD_WIN = 0x0008;
+
+constexpr UINT VK_BACK = 0x08;
+constexpr UINT VK_TAB = 0x09;
+constexpr UINT VK_RETURN = 0x0D;
+constexpr UINT VK_SHIFT = 0x10;
+constexpr UINT VK_CONTROL = 0x11;
+constexpr UINT VK_MENU = 0x12;
+constexpr UINT VK_ESCAPE = 0x1B;
+constexpr UINT VK_SPACE = 0x20;
+constexpr UINT VK_LEFT = 0x25;
+constexpr UINT VK_UP = 0x26;
+constexpr UINT VK_RIGHT = 0x27;
+constexpr UINT VK_DOWN = 0x28;
+constexpr UINT VK_LWIN = 0x5B;
+constexpr UINT VK_RWIN = 0x5C;
+constexpr UINT VK_LSHIFT = 0xA0;
+constexpr UINT VK_RSHIFT = 0xA1;
+constexpr UINT VK_LCONTROL = 0xA2;
+constexpr UINT VK_RCONTROL = 0xA3;
+constexpr UINT VK_LMENU = 0xA4;
+constexpr UINT VK_RMENU = 0xA5;
 #endif
 
 // hash and equality implementations for Windows API's GUID type to make it useable as hash map key.
@@ -71,8 +118,11 @@ private:
 	std::function<void()> m_callback;
 };
 
+#ifdef _WIN32
 std::string utf16_to_utf8(const std::wstring& utf16);
 std::wstring utf8_to_utf16(const std::string& utf8);
+#endif
+
 std::string to_lower(std::string_view str);
 std::string_view ltrim(std::string_view s, const std::string_view& chars = " \t\n\r\f\v");
 std::string_view rtrim(std::string_view s, const std::string_view& chars = " \t\n\r\f\v");
@@ -101,6 +151,7 @@ enum class Direction {
 };
 
 Direction opposite(Direction dir);
+size_t axis_of(Direction dir);
 std::string to_string(Direction dir);
 Direction to_direction(const std::string& str);
 
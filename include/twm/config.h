@@ -8,26 +8,59 @@
 
 #include <chrono>
 #include <filesystem>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
 
 namespace twm {
 
-struct Config {
-	float tick_interval_seconds = 0.005f;
+// A config file that was read, parsed, and validated, but not yet loaded. That is the part of loading that can fail
+// on malformed files and may take a while, so it can happen on any thread. Loading registers hotkeys and must
+// therefore happen on the main thread.
+struct ParsedConfig;
+
+class KeyMatcher;
+
+// Throws if the file can't be read or parsed, or if anything in it is invalid.
+std::shared_ptr<const ParsedConfig> parse_config_file(const std::filesystem::path& path);
+
+// Everything in a config but its hotkeys, which are registered with the system rather than just stored
+struct ConfigValues {
 	float update_interval_seconds = 0.1f;
+	float reconcile_interval_seconds = 2.0f;
+	float window_call_timeout_seconds = 0.2f;
 	bool disable_drop_shadows = false;
 	bool disable_rounded_corners = false;
 	bool draw_focus_border = false;
+	bool enable_tiling = false;
 	uint32_t focused_border_color = 0x999999;
 	uint32_t unfocused_border_color = 0x333333;
+
+	// Key sequences and modes, see input.h. `key_matcher` is compiled from them, or nullptr if there are none.
+	std::vector<Binding> sequences;
+	std::map<std::string, std::vector<Binding>> modes;
+	std::shared_ptr<const KeyMatcher> key_matcher;
+};
+
+struct Config : ConfigValues {
 	Hotkeys hotkeys;
 
+	// Replace the whole config, such that settings that the new one lacks go back to their defaults. Either
+	// nothing changes, because the new config throws while being parsed, or all of it is loaded. Keycombos that
+	// the system refuses to register are the exception: they are left out with a warning, see Hotkeys::set.
 	void load_default();
 	void load_from_file(const std::filesystem::path& path);
-	void load_from_string(std::string_view path);
+	void load_from_string(std::string_view content);
+	void load(const ParsedConfig& parsed);
 	void save(std::ostream& out) const;
 
-	clock::duration tick_interval() const { return std::chrono::duration_cast<clock::duration>(std::chrono::duration<float>(tick_interval_seconds)); }
 	clock::duration update_interval() const { return std::chrono::duration_cast<clock::duration>(std::chrono::duration<float>(update_interval_seconds)); }
+	clock::duration reconcile_interval() const { return std::chrono::duration_cast<clock::duration>(std::chrono::duration<float>(reconcile_interval_seconds)); }
+	clock::duration window_call_timeout() const { return std::chrono::duration_cast<clock::duration>(std::chrono::duration<float>(window_call_timeout_seconds)); }
 };
 
+// The config that twm currently runs with
+extern Config cfg;
+
 } // namespace twm
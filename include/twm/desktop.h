@@ -0,0 +1,222 @@
+// This file was developed by Thomas Müller <thomas94@gmx.net>.
+// It is published under the GPU GPLv3 license; see LICENSE.txt for details.
+
+#pragma once
+
+#include <twm/bsp.h>
+#include <twm/common.h>
+#include <twm/events.h>
+#include <twm/math.h>
+#include <twm/platform.h>
+#include <twm/spatial_index.h>
+
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace twm {
+
+class Window {
+	// Fetched on first use, because it is only needed for logging and fetching it is a
+	// cross-process call. Whether the window has a name at all is cheap to check.
+	// Dropped when the window reports a name change.
+	mutable std::optional<std::string> m_name = {};
+	Rect m_rect = {};
+	HWND m_handle = nullptr;
+	clock::time_point m_last_interacted_time = {};
+	bool m_marked_for_deletion = false;
+
+	Window(HWND handle) : m_rect{get_window_frame_bounds(handle)}, m_handle{handle} {}
+
+	// Re-reads the rect and applies global style settings to the window. Only
+	// actual changes reach DWM.
+	void update();
+
+	void mark_for_deletion() { m_marked_for_deletion = true; }
+	bool marked_for_deletion() const { return m_marked_for_deletion; }
+	void update_last_interacted_time() { m_last_interacted_time = clock::now(); }
+
+public:
+	friend class Desktop;
+
+	static Window* focused();
+	static bool focus_adjacent(Direction dir);
+	static bool focus_adjacent_or_default(Direction dir);
+	static bool swap_adjacent(Direction dir);
+	static bool move_to_adjacent_desktop(Direction dir);
+	static Window* get(HWND handle);
+
+	// Returns the focused window and its neighbor in the given direction.
+	// The neighbor is validated before it is returned, see definition.
+	static std::pair<Window*, Window*> focused_and_adjacent(Direction dir);
+
+	Window* get_adjacent(Direction dir) const;
+
+	bool focus();
+
+	void set_border_color(uint32_t color) { set_window_border_color(m_handle, color); }
+	void set_rounded_corners(RoundedCornerPreference rounded) { set_window_rounded_corners(m_handle, rounded); }
+	void update_border_color(bool is_focused);
+
+	auto last_focus_time() const { return m_last_interacted_time; }
+
+	bool terminate() const { return terminate_process(m_handle); }
+	bool close() const { return close_window(m_handle); }
+
+	const std::string& name() const {
+		if (!m_name.has_value()) {
+			m_name = get_window_text(m_handle);
+		}
+
+		return m_name.value();
+	}
+
+	const Rect& rect() const { return m_rect; }
+	bool set_rect(const Rect& r);
+
+	// Moves all given windows in a single transaction. Returns false if any of them could not be moved.
+	static bool set_rects(const std::vector<std::pair<Window*, Rect>>& targets);
+
+	HWND handle() const { return m_handle; }
+
+	// Cheap check whether the window can still be acted upon.
+	bool is_alive() const { return is_window(m_handle) && is_window_visible(m_handle) && !is_window_minimized(m_handle); }
+};
+
+class Desktop {
+	std::unordered_map<HWND, Window> m_windows = {};
+	SpatialIndex m_index = {};
+	BspTree m_tree = {};
+	HWND m_last_focus = nullptr;
+	GUID m_id = {};
+
+	bool can_be_managed(HWND handle) {
+		return window_has_text(handle) && !is_window_minimized(handle) && is_window_visible(handle);
+	}
+
+	// Where each managed window lives, such that looking up a window's desktop takes a single probe rather than
+	// one per desktop. Pointers stay valid, because neither map ever moves its elements.
+	struct Location {
+		Desktop* desktop;
+		Window* window;
+	};
+
+	static auto& locations() {
+		static std::unordered_map<HWND, Location> locations = {};
+		return locations;
+	}
+
+	bool try_manage(HWND handle, bool is_focused);
+	void unmanage(HWND handle);
+
+	// All windows leave `m_windows` through here to keep `locations()` current.
+	std::unordered_map<HWND, Window>::iterator erase_window(std::unordered_map<HWND, Window>::iterator it);
+
+	void tile(HWND handle);
+
+	// Moves the windows to the rects computed by the tiling layout. Windows that are no longer managed are skipped.
+	bool apply_layout(const BspTree::Changes& changes);
+
+	// All changes to a managed window's rect must go through here to keep the spatial index current.
+	void update_rect(Window& w, const Rect& r);
+
+	// Switches to the desktop and focuses it. `start` is when the action began, for logging the latency.
+	static void show(const GUID& id, clock::time_point start);
+
+	void pre_update();
+	void post_update();
+
+public:
+	friend class Window;
+
+	Desktop(const GUID& id) : m_id{id} {}
+	~Desktop();
+
+	// Not even movable: `locations()` points into desktops.
+	Desktop(const Desktop& other) = delete;
+	Desktop(Desktop&& other) = delete;
+	Desktop& operator=(const Desktop& other) = delete;
+	Desktop& operator=(Desktop&& other) = delete;
+
+	static auto& all() {
+		// Desktops remove their windows from `locations()` when destroyed, so it must outlive them.
+		locations();
+		static std::unordered_map<GUID, Desktop> desktops = {};
+		return desktops;
+	}
+
+	// ID of the desktop the user is currently looking at.
+	static auto& current_id() {
+		static std::optional<GUID> current_desktop_id = {};
+		return current_desktop_id;
+	}
+
+	// Whether desktop switch notifications keep `current_id()` up to date. If not, or if the
+	// current desktop is unknown nonetheless, `update_all` infers it from the windows it sees.
+	static auto& tracks_current_id() {
+		static bool tracks_current_id = false;
+		return tracks_current_id;
+	}
+
+	// Also creates the desktop, such that `current()` is valid even while it has no windows.
+	static void set_current_id(const std::optional<GUID>& id);
+
+	static void update_all();
+
+	// Re-evaluates a single window: looks up its desktop and (re-)manages it
+	// there, or drops it if it can no longer be managed.
+	static void refresh(HWND handle, bool is_focused = false);
+
+	static void forget(HWND handle);
+
+	// Incrementally applies a window event. Empty desktops are not erased
+	// here; that is left to the periodic `update_all` reconciliation.
+	static void apply(const WindowEvent& event);
+
+	// Cheap alternative to `update_all` before hotkey actions that relies on
+	// window events to keep everything else up to date: only the foreground
+	// window is refreshed. Actions refresh their candidate window's rect
+	// themselves, right before acting on it.
+	static void refresh_for_action();
+
+	// Brings the tiling layout in line with the config after it was (re-)loaded.
+	static void update_tiling();
+
+	static Desktop* current() { return current_id().has_value() ? get(current_id().value()) : nullptr; }
+	static Desktop* get(HWND handle) {
+		auto it = locations().find(handle);
+		return it != locations().end() ? it->second.desktop : nullptr;
+	}
+
+	static Desktop* get(GUID id);
+
+	// Switch through the shell's desktop manager, such that the new desktop is known to be current right away and
+	// is focused by twm. Where the manager is unavailable, `focus_adjacent` falls back to the shell's keyboard
+	// shortcuts and a full update, whereas desktops can't be focused by index.
+	static void focus_adjacent(Direction dir);
+	static void focus_index(size_t index);
+
+	Window* last_focus_or_default();
+
+	// Returns true if focus changed
+	bool ensure_focus();
+
+	bool move_window_to_here(HWND handle);
+
+	Window* get_window(HWND handle) {
+		auto it = m_windows.find(handle);
+		return it != m_windows.end() ? &it->second : nullptr;
+	}
+
+	Window* get_adjacent_window(HWND handle, Direction dir);
+
+	bool empty() const { return m_windows.empty(); }
+
+	const GUID& id() const { return m_id; }
+
+	void print() const;
+};
+
+} // namespace twm
@@ -0,0 +1,83 @@
+// This file was developed by Thomas Müller <thomas94@gmx.net>.
+// It is published under the GPU GPLv3 license; see LICENSE.txt for details.
+
+#pragma once
+
+#include <twm/common.h>
+
+#include <optional>
+#include <vector>
+
+namespace twm {
+
+enum class WindowEventType {
+	Created,
+	Destroyed,
+	Shown,
+	Hidden,
+	Minimized,
+	Restored,
+	LocationChanged,
+	NameChanged,
+	Foreground,
+
+	// Windows cloaks the windows of all but the current virtual desktop, so these also signal moves between desktops.
+	Cloaked,
+	Uncloaked,
+};
+
+struct WindowEvent {
+	WindowEventType type;
+	HWND handle;
+
+	bool operator==(const WindowEvent& other) const { return type == other.type && handle == other.handle; }
+};
+
+// Source of changes to top-level windows. The main loop drains it and
+// applies the events incrementally to the tracked desktops, which is much
+// cheaper than re-enumerating all windows. Obtained from the platform,
+// such that the tracking logic can also be driven by a simulation.
+class WindowEventSource {
+public:
+	virtual ~WindowEventSource() = default;
+
+	// Appends all events that arrived since the last call to `events`.
+	virtual void drain(std::vector<WindowEvent>& events) = 0;
+};
+
+// Source of switches between virtual desktops, such that the current one is always known. Otherwise, it can only
+// be inferred from the windows on it, which takes a COM call per window and fails on empty desktops.
+class DesktopSwitchSource {
+public:
+	virtual ~DesktopSwitchSource() = default;
+
+	// Signalled when the current desktop may have changed. For the main loop to wait on.
+	virtual HANDLE handle() const = 0;
+
+	// Call after `handle()` was signalled to re-arm it for the next switch. Before reading the current desktop, such
+	// that no switch can slip through in between.
+	virtual void rearm() = 0;
+
+	virtual std::optional<GUID> current_desktop() = 0;
+};
+
+// Source of changes to the files in a directory, e.g. to reload the config when it is edited.
+class DirectoryChangeSource {
+public:
+	virtual ~DirectoryChangeSource() = default;
+
+	// Signalled when a file in the directory is created, deleted, renamed, or written to. For the main loop to wait on.
+	virtual HANDLE handle() const = 0;
+
+	// Call after `handle()` was signalled to re-arm it for the next change.
+	virtual void rearm() = 0;
+};
+
+// Sees every key press and release, system-wide and before applications do (see
+// Platform::create_keyboard_hook). Unhooks when destroyed.
+class KeyboardHook {
+public:
+	virtual ~KeyboardHook() = default;
+};
+
+} // namespace twm
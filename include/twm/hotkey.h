@@ -3,7 +3,11 @@
 
 #pragma once
 
+#include <twm/action.h>
+
+#include <deque>
 #include <string>
+#include <utility>
 #include <vector>
 
 namespace twm {
@@ -14,14 +18,43 @@ enum class SendMode {
 	Release,
 };
 
+// Modifiers (MOD_*) and keycode of a keycombo of the form mod1-mod2-...-key, such as "ctrl-alt-h", case insensitive
+// and with optional spaces. The keycode is 0 if there is no key. Throws if a part of the keycombo is invalid,
+// naming it. See keys.h for the names of keys.
+std::pair<UINT, UINT> parse_keycombo(std::string_view keycombo);
+
 struct Hotkey {
 	int id;
 	std::string action;
 	std::string keycombo;
+	Command command;
+	UINT modifiers;
+	UINT keycode;
+};
+
+// A keycombo and the action that it triggers, as written in the config
+struct Binding {
+	std::string keycombo;
+	std::string action;
 };
 
+// Hotkey IDs consist of a slot, which is reused once its hotkey is gone, and the slot's generation, which changes
+// each time that happens. A hotkey message that was posted before its hotkey was removed therefore doesn't match
+// the hotkey that took over the slot.
 class Hotkeys {
+	struct Slot {
+		int generation = 0;
+		// Into m_hotkeys, or -1 if the slot is free
+		int index = -1;
+	};
+
 	std::vector<Hotkey> m_hotkeys;
+	std::vector<Slot> m_slots;
+	std::deque<int> m_free_slots;
+
+	int acquire_id();
+	void release_id(int id);
+	void index_slots();
 
 public:
 	~Hotkeys() { clear(); }
@@ -31,8 +64,27 @@ public:
 	// by the Windows API (e.g. for switching virtual desktops).
 	static void send_to_system(const std::string& keycombo, SendMode mode = SendMode::PressAndRelease);
 
+	// Throws if either the keycombo or the action is invalid, in which case nothing is registered.
 	void add(std::string_view keycombo, std::string_view action);
-	std::string_view action_of(int id) const;
+
+	// Parses `bindings` into hotkeys that `set` accepts, with IDs left to be assigned. Throws if any keycombo or
+	// action is invalid or if two bindings have the same keys. Doesn't touch any hotkeys and may therefore be
+	// called on any thread.
+	static std::vector<Hotkey> parse(const std::vector<Binding>& bindings);
+
+	// Replaces the hotkeys with `hotkeys`, as returned by `parse`. Only keycombos that are new get registered and
+	// only those that are gone get unregistered. The others stay registered throughout and keep their IDs, even if
+	// their action changes. Throws if there are too many hotkeys or two with the same keys, in which case nothing
+	// changes. Keycombos that the system refuses to register, e.g. because another application holds them, don't
+	// fail the others: they are left out and their errors returned.
+	std::vector<std::string> set(std::vector<Hotkey> hotkeys);
+
+	// Validates all of `bindings` before anything changes, see `parse`.
+	std::vector<std::string> set(const std::vector<Binding>& bindings) { return set(parse(bindings)); }
+
+	// Returns nullptr if no current hotkey has the given ID, e.g. because it was removed after its message was posted.
+	const Hotkey* find(int id) const;
+	const Hotkey& get(int id) const;
 	void clear();
 
 	const std::vector<Hotkey>& hotkeys() const { return m_hotkeys; }
@@ -0,0 +1,206 @@
+// This file was developed by Thomas Müller <thomas94@gmx.net>.
+// It is published under the GPU GPLv3 license; see LICENSE.txt for details.
+
+#pragma once
+
+#include <twm/action.h>
+#include <twm/common.h>
+#include <twm/events.h>
+#include <twm/hotkey.h>
+#include <twm/platform.h>
+
+#include <array>
+#include <atomic>
+#include <bitset>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace twm {
+
+// Key sequences such as "alt-space f l", i.e. keycombos pressed one after the other, and modes, i.e. sets of such
+// bindings that are only active while twm is in them. RegisterHotKey only supports single keycombos, so these are
+// served by a low-level keyboard hook instead, which sees every key press and release before applications do.
+
+// A key together with the modifiers (MOD_*) that are held while pressing it
+using Chord = uint32_t;
+
+inline Chord to_chord(UINT modifiers, UINT keycode) { return modifiers << 16 | keycode; }
+
+// The bindings of all modes, compiled into a state machine with one state per prefix of a key sequence. Resolving a
+// key press is a single hash table lookup, no matter how many bindings there are.
+class KeyMatcher {
+public:
+	struct Target {
+		uint32_t state = 0;
+		// Into `commands()`, or -1 if the key only leads to `state`: the rest of a sequence, or another mode.
+		int32_t command = -1;
+	};
+
+	// The action "mode <name>" switches to the mode of that name, and "mode default" back to `sequences`.
+	// Throws if a binding is invalid or conflicts with another, naming it.
+	KeyMatcher(const std::vector<Binding>& sequences, const std::map<std::string, std::vector<Binding>>& modes);
+
+	// No key of a sequence was pressed yet, in the default mode.
+	static constexpr uint32_t ROOT = 0;
+
+	// Where pressing `chord` in `state` leads, or nullptr if it does not continue any sequence.
+	const Target* find(uint32_t state, Chord chord) const {
+		uint64_t key = (uint64_t)state << 32 | chord;
+		for (size_t i = hash(key);; i = (i + 1) & m_mask) {
+			if (m_table[i].key == key) {
+				return &m_table[i].target;
+			} else if (m_table[i].key == EMPTY) {
+				return nullptr;
+			}
+		}
+	}
+
+	// No key of a sequence was pressed yet, in the mode of `state`.
+	uint32_t root(uint32_t state) const { return m_roots[state]; }
+
+	const std::vector<Command>& commands() const { return m_commands; }
+
+	// The most entries that a lookup visits
+	size_t max_probes() const { return m_max_probes; }
+
+private:
+	static constexpr uint64_t EMPTY = ~0ull;
+
+	struct Entry {
+		uint64_t key = EMPTY;
+		Target target;
+	};
+
+	size_t hash(uint64_t key) const { return (size_t)((key * 0x9E3779B97F4A7C15ull) >> m_shift) & m_mask; }
+
+	// Open addressing with linear probing, at most half full
+	std::vector<Entry> m_table;
+	size_t m_mask = 0;
+	int m_shift = 0;
+	size_t m_max_probes = 0;
+
+	std::vector<uint32_t> m_roots;
+	std::vector<Command> m_commands;
+};
+
+// Bounded queue from one producer thread to one consumer thread that neither locks nor allocates.
+template <typename T, size_t N> class SpscQueue {
+public:
+	// Returns false if the queue is full. Must only be called by the producer.
+	bool try_push(const T& item) {
+		size_t head = m_head.load(std::memory_order_relaxed);
+		if (head - m_tail.load(std::memory_order_acquire) == N) {
+			return false;
+		}
+
+		m_items[head % N] = item;
+		m_head.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Returns false if the queue is empty. Must only be called by the consumer.
+	bool try_pop(T& item) {
+		size_t tail = m_tail.load(std::memory_order_relaxed);
+		if (tail == m_head.load(std::memory_order_acquire)) {
+			return false;
+		}
+
+		item = m_items[tail % N];
+		m_tail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+private:
+	std::array<T, N> m_items = {};
+
+	// Producer and consumer each get their own cache line.
+	alignas(64) std::atomic<size_t> m_head = 0;
+	alignas(64) std::atomic<size_t> m_tail = 0;
+};
+
+// Resolves the key presses that a keyboard hook sees through a KeyMatcher and hands the commands that they trigger to
+// the main loop. Resolving happens on the hook's thread, which Windows gives only so much time per key before it
+// removes the hook, so `on_key` does bounded work: no locks, no allocations, no logging, and no waiting on the main
+// loop, which may be busy.
+//
+// Keys that continue a sequence are swallowed, as are the keys that break one off. Outside of the default mode, all
+// keys but modifiers are swallowed, and escape returns to the default mode unless it is bound.
+class InputEngine {
+public:
+	// Throws if the keyboard can't be hooked.
+	InputEngine();
+	~InputEngine();
+
+	InputEngine(const InputEngine& other) = delete;
+	InputEngine& operator=(const InputEngine& other) = delete;
+
+	// Takes effect with the next key press, which starts over in the default mode. Doesn't wait for the hook: the
+	// previous matcher is kept alive until the hook is done with it.
+	void set_matcher(std::shared_ptr<const KeyMatcher> matcher);
+
+	// Signalled when commands were triggered. For the main loop to wait on.
+	HANDLE handle() const { return m_event; }
+
+	// Calls `fn` with each command that was triggered since the previous call and when its last key was pressed.
+	// Also frees previous matchers that the hook is done with.
+	void drain(const std::function<void(const Command&, clock::time_point)>& fn);
+
+	// Called by the hook for each key press and release. Returns whether to swallow the key.
+	bool on_key(const KeyInput& key);
+
+	// Commands that were dropped because the main loop did not keep up
+	size_t n_dropped() const { return m_n_dropped.load(std::memory_order_relaxed); }
+
+private:
+	struct Triggered {
+		Command command;
+		clock::time_point time;
+	};
+
+	// A matcher as handed to the hook's thread. The generation tells it apart from previous matchers, one of which
+	// may have had the same address.
+	struct Published {
+		std::shared_ptr<const KeyMatcher> matcher;
+		uint64_t generation;
+	};
+
+	// A matcher that was replaced, and how many keys the hook had resolved by then
+	struct Retired {
+		std::unique_ptr<const Published> published;
+		size_t n_resolved;
+	};
+
+	bool resolve(const KeyInput& key);
+
+	// Frees the retired matchers that the hook can no longer be using: it is outside of `on_key`, or it finished a
+	// key since, the next one of which sees the current matcher.
+	void collect_retired();
+
+	// Owned by the main thread. The hook's thread uses `m_active` while it marks `m_in_callback` and counts the keys
+	// that it resolved.
+	std::unique_ptr<const Published> m_published;
+	std::vector<Retired> m_retired;
+	uint64_t m_generation = 0;
+	std::atomic<const Published*> m_active = nullptr;
+	std::atomic<bool> m_in_callback = false;
+	std::atomic<size_t> m_n_resolved = 0;
+
+	// Only used by the hook's thread
+	uint64_t m_state_generation = 0;
+	uint32_t m_state = KeyMatcher::ROOT;
+	clock::time_point m_sequence_time = {};
+	uint32_t m_held_modifier_keys = 0;
+	std::bitset<256> m_swallowed;
+
+	SpscQueue<Triggered, 256> m_queue;
+	std::atomic<size_t> m_n_dropped = 0;
+	HANDLE m_event = nullptr;
+
+	// Last, such that the hook is gone before anything it uses.
+	std::unique_ptr<KeyboardHook> m_hook;
+};
+
+} // namespace twm
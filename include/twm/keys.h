@@ -0,0 +1,412 @@
+// This file was developed by Thomas Müller <thomas94@gmx.net>.
+// It is published under the GPU GPLv3 license; see LICENSE.txt for details.
+
+#pragma once
+
+#include <twm/common.h>
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
+#include <string_view>
+
+namespace twm {
+
+// A name of a key in keycombos and its virtual-key code (VK_*). Names are lowercase, because keycombos are matched
+// case-insensitively.
+struct KeyName {
+	std::string_view name;
+	UINT keycode;
+};
+
+// All key names. The first name of each key is its canonical one, the others are aliases.
+inline constexpr KeyName KEY_NAMES[] = {
+	// Editing and navigation
+	{"backspace",        0x08},
+	{"back",             0x08},
+	{"tab",              0x09},
+	{"clear",            0x0C},
+	{"enter",            0x0D},
+	{"return",           0x0D},
+	{"pause",            0x13},
+	{"capslock",         0x14},
+	{"caps",             0x14},
+	{"escape",           0x1B},
+	{"esc",              0x1B},
+	{"space",            0x20},
+	{"pageup",           0x21},
+	{"pgup",             0x21},
+	{"prior",            0x21},
+	{"pagedown",         0x22},
+	{"pgdn",             0x22},
+	{"next",             0x22},
+	{"end",              0x23},
+	{"home",             0x24},
+	{"left",             0x25},
+	{"up",               0x26},
+	{"right",            0x27},
+	{"down",             0x28},
+	{"select",           0x29},
+	{"print",            0x2A},
+	{"execute",          0x2B},
+	{"printscreen",      0x2C},
+	{"prtsc",            0x2C},
+	{"snapshot",         0x2C},
+	{"insert",           0x2D},
+	{"ins",              0x2D},
+	{"delete",           0x2E},
+	{"del",              0x2E},
+	{"help",             0x2F},
+
+	// Modifiers. The sided ones are keys in their own right rather than modifiers of a keycombo.
+	{"shift",            0x10},
+	{"ctrl",             0x11},
+	{"control",          0x11},
+	{"alt",              0x12},
+	{"win",              0x5B},
+	{"super",            0x5B},
+	{"lwin",             0x5B},
+	{"rwin",             0x5C},
+	{"lshift",           0xA0},
+	{"rshift",           0xA1},
+	{"lctrl",            0xA2},
+	{"lcontrol",         0xA2},
+	{"rctrl",            0xA3},
+	{"rcontrol",         0xA3},
+	{"lalt",             0xA4},
+	{"ralt",             0xA5},
+
+	// Digits and letters
+	{"0",                0x30},
+	{"1",                0x31},
+	{"2",                0x32},
+	{"3",                0x33},
+	{"4",                0x34},
+	{"5",                0x35},
+	{"6",                0x36},
+	{"7",                0x37},
+	{"8",                0x38},
+	{"9",                0x39},
+	{"a",                0x41},
+	{"b",                0x42},
+	{"c",                0x43},
+	{"d",                0x44},
+	{"e",                0x45},
+	{"f",                0x46},
+	{"g",                0x47},
+	{"h",                0x48},
+	{"i",                0x49},
+	{"j",                0x4A},
+	{"k",                0x4B},
+	{"l",                0x4C},
+	{"m",                0x4D},
+	{"n",                0x4E},
+	{"o",                0x4F},
+	{"p",                0x50},
+	{"q",                0x51},
+	{"r",                0x52},
+	{"s",                0x53},
+	{"t",                0x54},
+	{"u",                0x55},
+	{"v",                0x56},
+	{"w",                0x57},
+	{"x",                0x58},
+	{"y",                0x59},
+	{"z",                0x5A},
+
+	// Numpad
+	{"numpad0",          0x60},
+	{"num0",             0x60},
+	{"numpad1",          0x61},
+	{"num1",             0x61},
+	{"numpad2",          0x62},
+	{"num2",             0x62},
+	{"numpad3",          0x63},
+	{"num3",             0x63},
+	{"numpad4",          0x64},
+	{"num4",             0x64},
+	{"numpad5",          0x65},
+	{"num5",             0x65},
+	{"numpad6",          0x66},
+	{"num6",             0x66},
+	{"numpad7",          0x67},
+	{"num7",             0x67},
+	{"numpad8",          0x68},
+	{"num8",             0x68},
+	{"numpad9",          0x69},
+	{"num9",             0x69},
+	{"multiply",         0x6A},
+	{"add",              0x6B},
+	{"separator",        0x6C},
+	{"subtract",         0x6D},
+	{"decimal",          0x6E},
+	{"divide",           0x6F},
+	{"numlock",          0x90},
+	{"scrolllock",       0x91},
+
+	// Function keys
+	{"f1",               0x70},
+	{"f2",               0x71},
+	{"f3",               0x72},
+	{"f4",               0x73},
+	{"f5",               0x74},
+	{"f6",               0x75},
+	{"f7",               0x76},
+	{"f8",               0x77},
+	{"f9",               0x78},
+	{"f10",              0x79},
+	{"f11",              0x7A},
+	{"f12",              0x7B},
+	{"f13",              0x7C},
+	{"f14",              0x7D},
+	{"f15",              0x7E},
+	{"f16",              0x7F},
+	{"f17",              0x80},
+	{"f18",              0x81},
+	{"f19",              0x82},
+	{"f20",              0x83},
+	{"f21",              0x84},
+	{"f22",              0x85},
+	{"f23",              0x86},
+	{"f24",              0x87},
+
+	// Punctuation of the US layout. The minus key has no symbol, because "-" separates the parts of a keycombo.
+	{"semicolon",        0xBA},
+	{";",                0xBA},
+	{"equals",           0xBB},
+	{"=",                0xBB},
+	{"plus",             0xBB},
+	{"comma",            0xBC},
+	{",",                0xBC},
+	{"minus",            0xBD},
+	{"period",           0xBE},
+	{".",                0xBE},
+	{"slash",            0xBF},
+	{"/",                0xBF},
+	{"backtick",         0xC0},
+	{"`",                0xC0},
+	{"grave",            0xC0},
+	{"lbracket",         0xDB},
+	{"[",                0xDB},
+	{"backslash",        0xDC},
+	{"\\",               0xDC},
+	{"rbracket",         0xDD},
+	{"]",                0xDD},
+	{"quote",            0xDE},
+	{"'",                0xDE},
+	{"apostrophe",       0xDE},
+	{"oem102",           0xE2},
+
+	// Application, browser, and media keys
+	{"apps",             0x5D},
+	{"contextmenu",      0x5D},
+	{"sleep",            0x5F},
+	{"browserback",      0xA6},
+	{"browserforward",   0xA7},
+	{"browserrefresh",   0xA8},
+	{"browserstop",      0xA9},
+	{"browsersearch",    0xAA},
+	{"browserfavorites", 0xAB},
+	{"browserhome",      0xAC},
+	{"volumemute",       0xAD},
+	{"mute",             0xAD},
+	{"volumedown",       0xAE},
+	{"volumeup",         0xAF},
+	{"nexttrack",        0xB0},
+	{"medianext",        0xB0},
+	{"prevtrack",        0xB1},
+	{"mediaprev",        0xB1},
+	{"mediastop",        0xB2},
+	{"playpause",        0xB3},
+	{"mediaplaypause",   0xB3},
+	{"mail",             0xB4},
+	{"mediaselect",      0xB5},
+	{"app1",             0xB6},
+	{"app2",             0xB7},
+};
+
+// The modifiers (MOD_*) that keycombos may hold. Their names are also keys of their own, see KEY_NAMES.
+struct ModifierName {
+	std::string_view name;
+	UINT modifier;
+};
+
+inline constexpr ModifierName MODIFIER_NAMES[] = {
+	{"ctrl",    MOD_CONTROL},
+	{"control", MOD_CONTROL},
+	{"alt",     MOD_ALT    },
+	{"super",   MOD_WIN    },
+	{"win",     MOD_WIN    },
+	{"shift",   MOD_SHIFT  },
+};
+
+// Looks up KEY_NAMES through a perfect hash (hash and displace) that is built at compile time: each name's bucket
+// holds a seed that sends all of the bucket's names to distinct slots, so a lookup takes one hash of the name and
+// one comparison. Building fails to compile if no such seeds exist, e.g. because a name is listed twice.
+//
+// Compilers limit how many steps a constant evaluation may take, MSVC to about a million by default. Searching for
+// the seeds would take a good share of those, so they are precomputed in SEEDS and merely checked. Only the buckets
+// whose seed no longer fits, because key names changed, are searched anew. The key_names test prints the seeds to
+// replace SEEDS with in that case.
+class KeyNameTable {
+public:
+	static constexpr size_t N_BUCKETS = 64;
+
+	consteval KeyNameTable() {
+		// The names of each bucket are `members[starts[b]]` to `members[starts[b + 1] - 1]`.
+		std::array<uint64_t, std::size(KEY_NAMES)> hashes = {};
+		std::array<size_t, N_BUCKETS + 1> starts = {};
+		for (size_t i = 0; i < std::size(KEY_NAMES); ++i) {
+			hashes[i] = hash(KEY_NAMES[i].name);
+			++starts[bucket(hashes[i]) + 1];
+		}
+
+		for (size_t b = 0; b < N_BUCKETS; ++b) {
+			starts[b + 1] += starts[b];
+		}
+
+		std::array<size_t, std::size(KEY_NAMES)> members = {};
+		auto ends = starts;
+		for (size_t i = 0; i < std::size(KEY_NAMES); ++i) {
+			members[ends[bucket(hashes[i])]++] = i;
+		}
+
+		for (size_t b = 0; b < N_BUCKETS; ++b) {
+			place_bucket(b, hashes, members.data() + starts[b], starts[b + 1] - starts[b]);
+		}
+
+		for (size_t i = std::size(KEY_NAMES); i-- > 0;) {
+			m_canonical_names[KEY_NAMES[i].keycode] = (int16_t)i;
+		}
+	}
+
+	// Takes a lowercase name. Returns nothing if there is no key of that name.
+	constexpr std::optional<UINT> find(std::string_view name) const {
+		uint64_t h = hash(name);
+		int16_t i = m_slots[slot(h, m_seeds[bucket(h)])];
+		if (i < 0 || KEY_NAMES[i].name != name) {
+			return {};
+		}
+
+		return KEY_NAMES[i].keycode;
+	}
+
+	// The canonical name of `keycode`, or an empty string if it has none.
+	constexpr std::string_view name(UINT keycode) const {
+		if (keycode >= m_canonical_names.size() || m_canonical_names[keycode] < 0) {
+			return {};
+		}
+
+		return KEY_NAMES[m_canonical_names[keycode]].name;
+	}
+
+	// The seeds that the table was built with. Differ from SEEDS only if those are out of date.
+	constexpr const std::array<uint16_t, N_BUCKETS>& seeds() const { return m_seeds; }
+
+	static constexpr std::array<uint16_t, N_BUCKETS> SEEDS = {
+		0, 0, 0, 0, 0, 0, 1, 1, 0, 0, 0, 0, 1, 0, 0, 0,
+		0, 0, 0, 0, 0, 0, 0, 2, 2, 2, 1, 0, 0, 0, 0, 0,
+		0, 0, 0, 0, 3, 0, 1, 0, 3, 2, 0, 1, 3, 1, 0, 2,
+		1, 0, 0, 0, 2, 0, 0, 0, 1, 6, 0, 0, 7, 1, 69, 6,
+	};
+
+private:
+	static constexpr size_t N_SLOTS = 512;
+	static_assert(std::size(KEY_NAMES) <= N_SLOTS / 2, "Too many key names for the table to be built quickly");
+
+	// FNV-1a
+	static constexpr uint64_t hash(std::string_view name) {
+		uint64_t h = 0xCBF29CE484222325ull;
+		for (char c : name) {
+			h = (h ^ (uint8_t)c) * 0x100000001B3ull;
+		}
+
+		return h;
+	}
+
+	static constexpr size_t bucket(uint64_t h) { return h % N_BUCKETS; }
+
+	static constexpr size_t slot(uint64_t h, uint16_t seed) {
+		uint64_t x = h + seed * 0x9E3779B97F4A7C15ull;
+		x = (x ^ (x >> 33)) * 0xFF51AFD7ED558CCDull;
+		return (x ^ (x >> 33)) % N_SLOTS;
+	}
+
+	consteval void place_bucket(
+		size_t b, const std::array<uint64_t, std::size(KEY_NAMES)>& hashes, const size_t* members, size_t n_members
+	) {
+		for (size_t j = 0; j < n_members; ++j) {
+			for (size_t k = 0; k < j; ++k) {
+				if (hashes[members[k]] == hashes[members[j]]) {
+					throw std::runtime_error{"Two key names hash alike. Is a name listed twice?"};
+				}
+			}
+		}
+
+		// Places the bucket's names in the slots that `seed` sends them to, or none if one of those is taken.
+		auto place = [&](uint16_t seed) {
+			for (size_t j = 0; j < n_members; ++j) {
+				size_t s = slot(hashes[members[j]], seed);
+				if (m_slots[s] >= 0) {
+					for (size_t k = 0; k < j; ++k) {
+						m_slots[slot(hashes[members[k]], seed)] = -1;
+					}
+
+					return false;
+				}
+
+				m_slots[s] = (int16_t)members[j];
+			}
+
+			m_seeds[b] = seed;
+			return true;
+		};
+
+		// The precomputed seed fits unless key names changed.
+		if (place(SEEDS[b])) {
+			return;
+		}
+
+		for (uint32_t seed = 0; seed <= UINT16_MAX; ++seed) {
+			if (place((uint16_t)seed)) {
+				return;
+			}
+		}
+
+		throw std::runtime_error{"No seed separates the key names of a bucket."};
+	}
+
+	std::array<uint16_t, N_BUCKETS> m_seeds = {};
+
+	// Indices into KEY_NAMES, or -1 if empty
+	std::array<int16_t, N_SLOTS> m_slots = make_empty<N_SLOTS>();
+	std::array<int16_t, 256> m_canonical_names = make_empty<256>();
+
+	template <size_t N> static constexpr std::array<int16_t, N> make_empty() {
+		std::array<int16_t, N> indices = {};
+		indices.fill(-1);
+		return indices;
+	}
+};
+
+inline constexpr KeyNameTable KEY_NAME_TABLE;
+
+// Takes a lowercase name. Returns nothing if there is no key of that name.
+constexpr std::optional<UINT> find_key(std::string_view name) { return KEY_NAME_TABLE.find(name); }
+
+// The canonical name of `keycode`, or an empty string if it has none.
+constexpr std::string_view key_name(UINT keycode) { return KEY_NAME_TABLE.name(keycode); }
+
+// Takes a lowercase name. Returns nothing if there is no modifier of that name.
+constexpr std::optional<UINT> find_modifier(std::string_view name) {
+	for (const auto& modifier : MODIFIER_NAMES) {
+		if (modifier.name == name) {
+			return modifier.modifier;
+		}
+	}
+
+	return {};
+}
+
+} // namespace twm
@@ -3,9 +3,20 @@
 
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <format>
+#include <new>
 #include <string>
+#include <string_view>
+#include <tuple>
 #include <type_traits>
+#include <utility>
+
+// Messages below this severity (0: debug, 1: info, 2: warning, 3: error) are compiled out entirely.
+#ifndef TWM_MIN_LOG_SEVERITY
+#	define TWM_MIN_LOG_SEVERITY 0
+#endif
 
 namespace twm {
 
@@ -16,31 +27,197 @@ enum class Severity : uint8_t {
 	Error,
 };
 
-void log(Severity severity, const std::string& str);
+constexpr Severity min_compiled_severity = (Severity)TWM_MIN_LOG_SEVERITY;
+
+// Messages below this severity are discarded at runtime, before they are formatted.
+extern Severity min_severity;
+
+inline bool log_enabled(Severity severity) { return severity >= min_compiled_severity && severity >= min_severity; }
+
+// How a format argument is captured for formatting later. `void` if it can't be, in which case the message is
+// formatted right away. Strings are copied, because whatever they point to may be gone by the time of formatting.
+template <typename T> struct DeferredLogArg {
+	using type = std::conditional_t<std::is_arithmetic_v<T>, T, void>;
+};
+template <> struct DeferredLogArg<std::string> {
+	using type = std::string;
+};
+template <> struct DeferredLogArg<std::string_view> {
+	using type = std::string;
+};
+template <> struct DeferredLogArg<const char*> {
+	using type = std::string;
+};
+template <> struct DeferredLogArg<char*> {
+	using type = std::string;
+};
+
+template <typename T> using deferred_log_arg_t = typename DeferredLogArg<std::decay_t<T>>::type;
+
+// A log message whose formatting can be deferred: the format string is a literal, so it is enough to keep the
+// arguments around, by value and without allocating, to format the message on the log's writer thread instead
+// of the thread that logs it.
+class LogRecord {
+public:
+	static const size_t MAX_ARGS_SIZE = 96;
+
+	LogRecord() = default;
+	LogRecord(Severity severity, std::string str) : m_severity{severity}, m_str{std::move(str)} {}
+
+	template <typename... Ts> LogRecord(Severity severity, std::format_string<Ts...> fmt, Ts&&... args) : m_severity{severity} {
+		using Args = std::tuple<deferred_log_arg_t<Ts>...>;
+		if constexpr ((std::is_void_v<deferred_log_arg_t<Ts>> || ...) || sizeof(Args) > MAX_ARGS_SIZE ||
+					  alignof(Args) > alignof(std::max_align_t)) {
+			m_str = std::format(fmt, std::forward<Ts>(args)...);
+		} else {
+			static constexpr Ops ops = {
+				[](void* args, std::string_view format_str) {
+					return std::apply(
+						[&](auto&... a) { return std::vformat(format_str, std::make_format_args(a...)); }, *(Args*)args
+					);
+				},
+				[](void* dst, void* src) {
+					new (dst) Args{std::move(*(Args*)src)};
+					((Args*)src)->~Args();
+				},
+				[](void* args) { ((Args*)args)->~Args(); },
+			};
+
+			new (m_args) Args{std::forward<Ts>(args)...};
+			m_fmt = fmt.get();
+			m_ops = &ops;
+		}
+	}
+
+	LogRecord(LogRecord&& other) noexcept { *this = std::move(other); }
+	LogRecord& operator=(LogRecord&& other) noexcept {
+		if (this != &other) {
+			reset();
+			m_severity = other.m_severity;
+			m_str = std::move(other.m_str);
+			m_fmt = other.m_fmt;
+			if ((m_ops = other.m_ops)) {
+				m_ops->move(m_args, other.m_args);
+				other.m_ops = nullptr;
+			}
+		}
+
+		return *this;
+	}
+
+	LogRecord(const LogRecord& other) = delete;
+	LogRecord& operator=(const LogRecord& other) = delete;
+
+	~LogRecord() { reset(); }
+
+	Severity severity() const { return m_severity; }
 
-void log_debug(const std::string& str);
-void log_info(const std::string& str);
-void log_warning(const std::string& str);
-void log_error(const std::string& str);
+	// Formats the message if that was deferred.
+	const std::string& str() {
+		if (m_ops) {
+			m_str = m_ops->format(m_args, m_fmt);
+			reset();
+		}
+
+		return m_str;
+	}
+
+private:
+	struct Ops {
+		std::string (*format)(void* args, std::string_view fmt);
+		void (*move)(void* dst, void* src);
+		void (*destroy)(void* args);
+	};
+
+	void reset() {
+		if (m_ops) {
+			m_ops->destroy(m_args);
+			m_ops = nullptr;
+		}
+	}
+
+	Severity m_severity = Severity::Info;
+	std::string m_str;
+
+	// Set if formatting was deferred
+	std::string_view m_fmt;
+	const Ops* m_ops = nullptr;
+	alignas(std::max_align_t) std::byte m_args[MAX_ARGS_SIZE];
+};
+
+// Messages are written by a background thread, such that logging never blocks the caller.
+void log(LogRecord&& record);
+void log(Severity severity, std::string str);
+
+
+// Blocks until all messages logged so far are written.
+void flush_log();
+
+// Messages that are logged while the queue is full are dropped, and their number reported once there is space again.
+size_t n_dropped_log_messages();
+
+// Plain messages. Like formatted ones, they are compiled out below `min_compiled_severity` and only turned into a
+// string of their own once they are known to be logged. Temporary strings are moved rather than copied.
+template <typename S> requires std::is_convertible_v<S&&, std::string> void log_debug(S&& str) {
+	if constexpr (Severity::Debug >= min_compiled_severity) {
+		if (log_enabled(Severity::Debug)) {
+			log(LogRecord{Severity::Debug, std::string{std::forward<S>(str)}});
+		}
+	}
+}
+
+template <typename S> requires std::is_convertible_v<S&&, std::string> void log_info(S&& str) {
+	if constexpr (Severity::Info >= min_compiled_severity) {
+		if (log_enabled(Severity::Info)) {
+			log(LogRecord{Severity::Info, std::string{std::forward<S>(str)}});
+		}
+	}
+}
+
+template <typename S> requires std::is_convertible_v<S&&, std::string> void log_warning(S&& str) {
+	if constexpr (Severity::Warning >= min_compiled_severity) {
+		if (log_enabled(Severity::Warning)) {
+			log(LogRecord{Severity::Warning, std::string{std::forward<S>(str)}});
+		}
+	}
+}
+
+template <typename S> requires std::is_convertible_v<S&&, std::string> void log_error(S&& str) {
+	if constexpr (Severity::Error >= min_compiled_severity) {
+		if (log_enabled(Severity::Error)) {
+			log(LogRecord{Severity::Error, std::string{std::forward<S>(str)}});
+		}
+	}
+}
 
 template <typename... Ts> requires(sizeof...(Ts) > 0) void log_format(Severity severity, const std::format_string<Ts...>& str, Ts&&... args) {
-	log(severity, std::format(str, std::forward<Ts>(args)...));
+	if (log_enabled(severity)) {
+		log(LogRecord{severity, str, std::forward<Ts>(args)...});
+	}
 }
 
 template <typename... Ts> requires(sizeof...(Ts) > 0) void log_debug(const std::format_string<Ts...>& str, Ts&&... args) {
-	log_format(Severity::Debug, str, std::forward<Ts>(args)...);
+	if constexpr (Severity::Debug >= min_compiled_severity) {
+		log_format(Severity::Debug, str, std::forward<Ts>(args)...);
+	}
 }
 
 template <typename... Ts> requires(sizeof...(Ts) > 0) void log_info(const std::format_string<Ts...>& str, Ts&&... args) {
-	log_format(Severity::Info, str, std::forward<Ts>(args)...);
+	if constexpr (Severity::Info >= min_compiled_severity) {
+		log_format(Severity::Info, str, std::forward<Ts>(args)...);
+	}
 }
 
 template <typename... Ts> requires(sizeof...(Ts) > 0) void log_warning(const std::format_string<Ts...>& str, Ts&&... args) {
-	log_format(Severity::Warning, str, std::forward<Ts>(args)...);
+	if constexpr (Severity::Warning >= min_compiled_severity) {
+		log_format(Severity::Warning, str, std::forward<Ts>(args)...);
+	}
 }
 
 template <typename... Ts> requires(sizeof...(Ts) > 0) void log_error(const std::format_string<Ts...>& str, Ts&&... args) {
-	log_format(Severity::Error, str, std::forward<Ts>(args)...);
+	if constexpr (Severity::Error >= min_compiled_severity) {
+		log_format(Severity::Error, str, std::forward<Ts>(args)...);
+	}
 }
 
 } // namespace twm
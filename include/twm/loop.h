@@ -0,0 +1,88 @@
+// This file was developed by Thomas Müller <thomas94@gmx.net>.
+// It is published under the GPU GPLv3 license; see LICENSE.txt for details.
+
+#pragma once
+
+#include <twm/common.h>
+#include <twm/platform.h>
+
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+namespace twm {
+
+struct LoopStats {
+	uint64_t n_wakeups = 0;
+	clock::time_point since = clock::now();
+
+	double wakeups_per_second() const {
+		return (double)n_wakeups / std::chrono::duration<double>(clock::now() - since).count();
+	}
+
+	void reset() { *this = {}; }
+};
+
+// Main loop of the application. Rather than polling, it blocks until
+// either a message arrives, a scheduled deadline passes, or one of the
+// registered handles is signalled, and then dispatches immediately. An
+// idle twm therefore does not wake up at all.
+class EventLoop {
+public:
+	using Callback = std::function<void()>;
+	using MessageHandler = std::function<bool(const Message&)>;
+
+	EventLoop();
+	~EventLoop();
+
+	EventLoop(const EventLoop& other) = delete;
+	EventLoop& operator=(const EventLoop& other) = delete;
+
+	// Runs `callback` once, as soon as possible after `time`.
+	void schedule(clock::time_point time, Callback callback);
+	void schedule_in(clock::duration delay, Callback callback) { schedule(clock::now() + delay, std::move(callback)); }
+
+	// Runs `callback` whenever `handle` is signalled.
+	void add_handle(HANDLE handle, Callback callback);
+	void remove_handle(HANDLE handle);
+
+	// Runs `callback` on the loop's thread as soon as possible. Unlike the
+	// other methods, may be called from any thread, e.g. to hand back the
+	// result of background work.
+	void post(Callback callback);
+
+	// Blocks until there is work, then dispatches all of it. Messages that
+	// are not associated with one of twm's windows are passed to `on_thread_message`.
+	// Returns false once `on_thread_message` returns false.
+	bool run_once(const MessageHandler& on_thread_message);
+
+	const LoopStats& stats() const { return m_stats; }
+	LoopStats& stats() { return m_stats; }
+
+private:
+	struct Task {
+		clock::time_point time;
+		Callback callback;
+	};
+
+	std::optional<clock::duration> timeout() const;
+	void run_due_tasks();
+	void run_posted();
+
+	// Kept as a min-heap by time.
+	std::vector<Task> m_tasks;
+
+	// Parallel arrays because the platform waits on a plain array of handles.
+	std::vector<HANDLE> m_handles;
+	std::vector<Callback> m_handle_callbacks;
+
+	// Set whenever a callback is posted
+	HANDLE m_posted_event = nullptr;
+	std::mutex m_posted_mutex;
+	std::vector<Callback> m_posted;
+
+	LoopStats m_stats;
+};
+
+} // namespace twm
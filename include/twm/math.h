@@ -63,9 +63,11 @@ struct Rect {
 
 	Rect() = default;
 	Rect(const Vec2& top_left, const Vec2& bottom_right) : top_left{top_left}, bottom_right{bottom_right} {}
+#ifdef _WIN32
 	Rect(const RECT& r) :
 		top_left{static_cast<float>(r.left), static_cast<float>(r.top)},
 		bottom_right{static_cast<float>(r.right), static_cast<float>(r.bottom)} {}
+#endif
 
 	Rect& operator-=(const Rect& other) { return *this = *this - other; }
 	Rect& operator+=(const Rect& other) { return *this = *this + other; }
@@ -4,16 +4,192 @@
 #pragma once
 
 #include <twm/common.h>
+#include <twm/events.h>
 #include <twm/math.h>
 
+#include <filesystem>
+#include <functional>
+#include <memory>
 #include <optional>
 #include <string>
+#include <vector>
 
 namespace twm {
 
+// State that the margin between a window's rect and its frame bounds
+// depends on (see set_window_frame_bounds below).
+struct WindowFrameState {
+	int64_t style = 0;
+	int64_t ex_style = 0;
+	uint32_t dpi = 0;
+	void* monitor = nullptr;
+
+	bool operator==(const WindowFrameState& other) const = default;
+};
+
+// Window attributes that are applied through DWM. The values are those of DWMWINDOWATTRIBUTE.
+enum class WindowAttribute : uint32_t {
+	CornerPreference = 33,
+	BorderColor = 34,
+};
+
+// Virtual desktops in the order that the task view shows them
+struct VirtualDesktops {
+	std::vector<GUID> ids;
+	size_t current = 0;
+};
+
+struct KeyInput {
+	UINT keycode;
+	bool release;
+};
+
+// Messages that are posted to twm's thread rather than to one of its windows.
+enum class MessageType {
+	Hotkey,
+	Quit,
+	Other,
+};
+
+struct Message {
+	MessageType type = MessageType::Other;
+	int hotkey_id = 0;
+	uint32_t raw_id = 0;
+
+	// When the message was posted. Coarse (~16 ms) on Windows.
+	clock::time_point posted = {};
+};
+
+// Everything twm needs from the operating system. All window management
+// logic goes through this interface, such that it can run against either
+// the real Windows API or a simulation of it (see SimulatedPlatform), the
+// latter of which allows building, benchmarking, and profiling the logic
+// on any operating system.
+//
+// Unless stated otherwise, methods that return a value throw
+// std::runtime_error when the window in question does not exist.
+class Platform {
+public:
+	virtual ~Platform() = default;
+
+	// All top-level windows, in z-order (topmost first).
+	virtual std::vector<HWND> enumerate_windows() = 0;
+	virtual HWND foreground_window() = 0;
+
+	// The following three return false for windows that don't exist.
+	virtual bool is_window(HWND handle) = 0;
+	virtual bool is_window_visible(HWND handle) = 0;
+	virtual bool is_window_minimized(HWND handle) = 0;
+
+	// Both must not block on the window's thread, which may be hung. Return
+	// an empty string and false, respectively, for windows that don't exist.
+	virtual std::string window_text(HWND handle) = 0;
+	virtual bool window_has_text(HWND handle) = 0;
+
+	virtual Rect window_rect(HWND handle) = 0;
+	virtual Rect window_frame_bounds(HWND handle) = 0;
+	virtual WindowFrameState window_frame_state(HWND handle) = 0;
+
+	virtual bool set_window_rect(HWND handle, const Rect& rect) = 0;
+
+	// Moves all windows at once, such that no intermediate state is ever
+	// shown. Returns the windows that could not be moved.
+	virtual std::vector<HWND> set_window_rects(const std::vector<std::pair<HWND, Rect>>& rects) = 0;
+
+	// Returns once the window's thread has answered, i.e. blocks for as long as it is hung. Returns false right away
+	// for windows that don't exist or that Windows already considers hung.
+	virtual bool ping_window(HWND handle) = 0;
+
+	// Windows' foreground lock only lets the thread that received the user's input change the foreground window, so
+	// this must be called on that thread: twm's main thread. It may silently fail otherwise.
+	virtual bool focus_window(HWND handle) = 0;
+	virtual bool close_window(HWND handle) = 0;
+	virtual bool terminate_process(HWND handle) = 0;
+
+	// Failures are ignored: not all windows support all attributes.
+	virtual void set_window_attribute(HWND handle, WindowAttribute attribute, uint32_t value) = 0;
+	virtual void set_system_dropshadow(bool enabled) = 0;
+
+	// Area of the primary monitor that is not covered by the taskbar
+	virtual Rect primary_work_area() = 0;
+
+	virtual std::optional<GUID> window_desktop_id(HWND handle) = 0;
+	virtual bool is_window_on_current_desktop(HWND handle) = 0;
+	virtual bool move_window_to_desktop(HWND handle, const GUID& desktop_id) = 0;
+
+	// Through the shell's desktop manager. Windows has no public API for either, so both throw if the manager is
+	// unavailable, in which case twm switches desktops with the shell's keyboard shortcuts instead. Switching returns
+	// once the desktop is current.
+	virtual VirtualDesktops virtual_desktops() = 0;
+	virtual void switch_to_desktop(const GUID& desktop_id) = 0;
+
+	// Hotkeys are delivered as messages of type MessageType::Hotkey.
+	virtual void register_hotkey(int id, UINT modifiers, UINT keycode) = 0;
+	virtual void unregister_hotkey(int id) = 0;
+
+	// Modifiers (MOD_*) that are currently held down
+	virtual UINT held_modifiers() = 0;
+	virtual void send_input(const std::vector<KeyInput>& inputs) = 0;
+
+	// Throws if window events are not available, in which case twm falls back to polling.
+	virtual std::unique_ptr<WindowEventSource> create_window_event_source() = 0;
+
+	// Throws if desktop switches can't be observed, in which case twm infers the current desktop from its windows.
+	virtual std::unique_ptr<DesktopSwitchSource> create_desktop_switch_source() = 0;
+
+	// Throws if the directory can't be watched.
+	virtual std::unique_ptr<DirectoryChangeSource> create_directory_change_source(const std::filesystem::path& dir) = 0;
+
+	// Calls `on_key` for every key press and release that the user makes, on a thread of its own. Returning true
+	// swallows the key, such that no application sees it. Windows removes hooks that take longer than its
+	// LowLevelHooksTimeout to return, so `on_key` must return quickly. Throws if the keyboard can't be hooked.
+	virtual std::unique_ptr<KeyboardHook> create_keyboard_hook(std::function<bool(const KeyInput&)> on_key) = 0;
+
+	// Auto-reset events that any thread can set to wake up `wait`.
+	virtual HANDLE create_event() = 0;
+	virtual void set_event(HANDLE handle) = 0;
+	virtual void close_event(HANDLE handle) = 0;
+
+	// Blocks until a message or window event arrives, one of `handles` is signalled,
+	// or `timeout` (if any) passes. Returns the index of the signalled handle, if any.
+	virtual std::optional<size_t> wait(const std::vector<HANDLE>& handles, std::optional<clock::duration> timeout) = 0;
+
+	// Removes the next thread message from the queue. Messages that belong to
+	// one of twm's own windows are dispatched to it instead of being returned.
+	virtual bool next_message(Message& message) = 0;
+
+	virtual bool is_autostart_enabled() = 0;
+	virtual bool set_autostart_enabled(bool value) = 0;
+};
+
+// The platform that all of the functions below operate on. Defaults to the
+// Windows API on Windows and to an empty SimulatedPlatform elsewhere.
+Platform& platform();
+
+// Replaces the current platform, which also drops all platform-specific caches.
+void set_platform(std::unique_ptr<Platform> platform);
+
+#ifdef _WIN32
+std::unique_ptr<Platform> create_windows_platform();
+
 int last_error_code();
 std::string error_string(int code);
 std::string last_error_string();
+#endif
+
+// Calls that need the cooperation of a window's thread, i.e. moving, focusing, closing, styling, and getting the
+// title of windows, block for as long as that thread is hung. They are therefore made on worker threads and given
+// up on after `timeout`, upon which they fail. The windows in question count as unresponsive until the call
+// returns after all. Calls to unresponsive windows fail right away. Focusing is the exception, because it must
+// happen on the calling thread (see Platform::focus_window): only pinging the window beforehand is given up on.
+void set_window_call_timeout(clock::duration timeout);
+bool is_window_responsive(HWND handle);
+
+std::vector<HWND> enumerate_windows();
+HWND get_foreground_window();
+bool is_window(HWND handle);
+bool is_window_visible(HWND handle);
+bool is_window_minimized(HWND handle);
 
 // On Windows, the size of a window can be expressed in
 // multiple ways: either as a "rect" or as an "(extended)
@@ -23,11 +199,37 @@ std::string last_error_string();
 // be a bit larger). In most situations, it is therefore
 // recommended to use the *_window_frame_bounds functions
 // and not the *_window_rect functions.
+//
+// Converting between the two requires the margin between them,
+// which is cached per window. It only changes with the window's
+// style, DPI, or monitor, all of which are cheap to check.
 bool set_window_rect(HWND handle, const Rect& r);
 Rect get_window_rect(HWND handle);
 bool set_window_frame_bounds(HWND handle, const Rect& r);
 Rect get_window_frame_bounds(HWND handle);
 
+// Area of the primary monitor that is not covered by the taskbar
+Rect get_primary_work_area();
+
+// Moves several windows at once. All moves are committed in a single
+// deferred-positioning batch, such that the compositor never shows an
+// intermediate state (e.g. overlapping windows halfway through a swap).
+class GeometryTransaction {
+public:
+	// Stages a move of the window to the given frame bounds. Moves that
+	// would not change anything are dropped right away.
+	void stage(HWND handle, const Rect& frame_bounds);
+
+	// Commits all staged moves and returns the windows that could not be moved.
+	std::vector<HWND> commit();
+
+	bool empty() const { return m_moves.empty() && m_failed.empty(); }
+
+private:
+	std::vector<std::pair<HWND, Rect>> m_moves;
+	std::vector<HWND> m_failed;
+};
+
 enum class RoundedCornerPreference {
 	Default = 0,
 	Disabled = 1,
@@ -55,9 +257,29 @@ enum class BorderColor : COLORREF {
 void set_window_border_color(HWND handle, COLORREF color);
 void set_system_dropshadow(bool enabled);
 
+// The DWM attribute setters above remember the last value they applied to
+// each window and skip calls that would not change anything. Each call is
+// a round trip to the compositor, after all. The cache of a window must be
+// invalidated when its handle may have been reused or its attributes may
+// have been changed by someone else.
+struct DwmAttributeStats {
+	uint64_t n_issued = 0;
+	uint64_t n_suppressed = 0;
+
+	// Not made, because the window was unresponsive, or made but timed out. Tried again next time.
+	uint64_t n_skipped = 0;
+};
+
+DwmAttributeStats dwm_attribute_stats();
+void invalidate_all_window_attributes();
+
+// Drops everything that is cached about the window (frame margin, DWM attributes, desktop).
+void invalidate_window_caches(HWND handle);
+
 bool focus_window(HWND handle); // returns false if the window could not be focused
 
 std::string get_window_text(HWND handle);
+bool window_has_text(HWND handle);
 bool terminate_process(HWND handle);
 bool close_window(HWND handle);
 
@@ -65,6 +287,24 @@ std::optional<GUID> get_window_desktop_id(HWND handle);
 bool is_window_on_current_desktop(HWND handle);
 bool move_window_to_desktop(HWND handle, const GUID& desktop_id);
 
+// Nothing if the shell's desktop manager is unavailable, which is logged once.
+std::optional<VirtualDesktops> get_virtual_desktops();
+bool switch_to_desktop(const GUID& desktop_id);
+
+// Each virtual desktop query is a COM round trip into explorer.exe. A window's desktop only changes when it is
+// created, shown, cloaked, or uncloaked, though, so if window events invalidate it on those occasions, the result
+// of `get_window_desktop_id` can be cached. Off by default, because nothing else would keep the cache current.
+void set_desktop_id_caching(bool enabled);
+void invalidate_window_desktop_id(HWND handle);
+
+struct VirtualDesktopStats {
+	// COM round trips
+	uint64_t n_queries = 0;
+	uint64_t n_cached = 0;
+};
+
+VirtualDesktopStats virtual_desktop_stats();
+
 bool is_autostart_enabled();
 bool set_autostart_enabled(bool value);
 
@@ -0,0 +1,241 @@
+// This file was developed by Thomas Müller <thomas94@gmx.net>.
+// It is published under the GPU GPLv3 license; see LICENSE.txt for details.
+
+#pragma once
+
+#include <twm/common.h>
+#include <twm/events.h>
+#include <twm/math.h>
+#include <twm/platform.h>
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace twm {
+
+// Categories of platform calls, each of which can be given a simulated latency.
+enum class SimulatedCall : size_t {
+	WindowQuery,  // cheap local queries: enumeration, visibility, rects, ...
+	WindowText,   // cross-process: the window's thread has to answer
+	Dwm,          // round trip to the compositor: frame bounds, attributes
+	Positioning,  // one per positioning call, including batches
+	WindowAction, // focus, close, terminate
+	VirtualDesktop,
+	Input,
+	Count,
+};
+
+// In-memory model of the windows, virtual desktops, and input queue of a
+// Windows session. Deterministic: handles and desktop IDs are assigned in
+// order, and nothing changes unless the simulation is told so. Changes
+// are reported as window events just like the real thing would, including
+// those that twm itself causes (e.g. moving a window).
+//
+// Thread-safe, such that a scenario can be scripted from another thread
+// while twm's loop blocks in `wait`.
+class SimulatedPlatform : public Platform {
+public:
+	SimulatedPlatform();
+
+	// Scripting the simulation
+
+	HWND create_window(const std::string& title, const Rect& frame_bounds, std::optional<GUID> desktop_id = {});
+	void destroy_window(HWND handle);
+	void set_window_title(HWND handle, const std::string& title);
+	void move_window(HWND handle, const Rect& frame_bounds);
+	void set_window_visible(HWND handle, bool visible);
+	void set_window_minimized(HWND handle, bool minimized);
+	void set_window_dpi(HWND handle, uint32_t dpi);
+	void activate_window(HWND handle);
+
+	// Calls that need the window's thread to respond (see set_window_call_timeout) block until it is no longer
+	// hung. Hung windows must be released before the simulation is destroyed.
+	void set_window_hung(HWND handle, bool hung);
+
+	// The value last set through `set_window_attribute`, if any
+	std::optional<uint32_t> window_attribute(HWND handle, WindowAttribute attribute) const;
+
+	// Margin between the rect and the frame bounds of windows created from now on
+	void set_frame_margin(const Rect& margin) { m_frame_margin = margin; }
+	void set_work_area(const Rect& work_area) { m_work_area = work_area; }
+
+	GUID create_desktop();
+	void switch_desktop(const GUID& desktop_id);
+	GUID current_desktop() const;
+
+	// Whether `virtual_desktops` and `switch_to_desktop` work, like they do on Windows versions whose desktop
+	// manager twm knows. Either way, ctrl-win-left/right in `send_input` switch desktops like the shell's shortcuts.
+	void set_desktop_manager_available(bool available) { m_desktop_manager_available = available; }
+
+	void post_hotkey(int id);
+	void post_quit();
+
+	// Signals the sources that watch the directory. The simulation has no file system of its own, so scenarios
+	// change actual files and report it here.
+	void notify_directory_changed(const std::filesystem::path& dir);
+
+	// Passes a key press or release of the user through the keyboard hooks, the most recent one first, on the calling
+	// thread. Returns whether one of them swallowed it. Hooks must not be destroyed meanwhile.
+	bool simulate_key(const KeyInput& key);
+
+	// Stand-ins for kernel event objects that can be waited on.
+	HANDLE create_handle();
+	void signal(HANDLE handle);
+
+	// Every call of the given category busy-waits this long, which models
+	// e.g. cross-process round trips. Defaults to zero.
+	void set_latency(SimulatedCall call, clock::duration latency);
+
+	uint64_t call_count(SimulatedCall call) const { return m_call_counts[(size_t)call]; }
+	void reset_call_counts();
+
+	// Modifiers and keycode of each registered hotkey by ID
+	std::unordered_map<int, std::pair<UINT, UINT>> registered_hotkeys() const;
+	std::vector<KeyInput> sent_input() const;
+
+	// The windows of each deferred-positioning batch (`set_window_rects`) so far, in order. Like BeginDeferWindowPos
+	// and EndDeferWindowPos, each batch is shown at once. Single moves (`set_window_rect`) are not batches.
+	std::vector<std::vector<HWND>> position_batches() const;
+
+	// Platform
+
+	std::vector<HWND> enumerate_windows() override;
+	HWND foreground_window() override;
+	bool is_window(HWND handle) override;
+	bool is_window_visible(HWND handle) override;
+	bool is_window_minimized(HWND handle) override;
+	std::string window_text(HWND handle) override;
+	bool window_has_text(HWND handle) override;
+	Rect window_rect(HWND handle) override;
+	Rect window_frame_bounds(HWND handle) override;
+	WindowFrameState window_frame_state(HWND handle) override;
+	bool set_window_rect(HWND handle, const Rect& rect) override;
+	std::vector<HWND> set_window_rects(const std::vector<std::pair<HWND, Rect>>& rects) override;
+	bool ping_window(HWND handle) override;
+	bool focus_window(HWND handle) override;
+	bool close_window(HWND handle) override;
+	bool terminate_process(HWND handle) override;
+	void set_window_attribute(HWND handle, WindowAttribute attribute, uint32_t value) override;
+	void set_system_dropshadow(bool enabled) override {}
+	Rect primary_work_area() override;
+	std::optional<GUID> window_desktop_id(HWND handle) override;
+	bool is_window_on_current_desktop(HWND handle) override;
+	bool move_window_to_desktop(HWND handle, const GUID& desktop_id) override;
+	VirtualDesktops virtual_desktops() override;
+	void switch_to_desktop(const GUID& desktop_id) override;
+	void register_hotkey(int id, UINT modifiers, UINT keycode) override;
+	void unregister_hotkey(int id) override;
+	UINT held_modifiers() override { return 0; }
+	void send_input(const std::vector<KeyInput>& inputs) override;
+	std::unique_ptr<WindowEventSource> create_window_event_source() override;
+	std::unique_ptr<DesktopSwitchSource> create_desktop_switch_source() override;
+	std::unique_ptr<DirectoryChangeSource> create_directory_change_source(const std::filesystem::path& dir) override;
+	std::unique_ptr<KeyboardHook> create_keyboard_hook(std::function<bool(const KeyInput&)> on_key) override;
+	HANDLE create_event() override { return create_handle(); }
+	void set_event(HANDLE handle) override { signal(handle); }
+	void close_event(HANDLE handle) override;
+	std::optional<size_t> wait(const std::vector<HANDLE>& handles, std::optional<clock::duration> timeout) override;
+	bool next_message(Message& message) override;
+	bool is_autostart_enabled() override { return false; }
+	bool set_autostart_enabled(bool value) override { return false; }
+
+private:
+	struct SimulatedWindow {
+		std::string title;
+		Rect frame_bounds;
+		Rect margin;
+		GUID desktop_id;
+		bool visible = true;
+		bool minimized = false;
+		uint32_t dpi = 96;
+		std::unordered_map<WindowAttribute, uint32_t> attributes = {};
+	};
+
+	friend class SimulatedEventSource;
+	friend class SimulatedDesktopSwitchSource;
+	friend class SimulatedDirectoryChangeSource;
+	friend class SimulatedKeyboardHook;
+
+	// Counts the call and spends its latency. Must not be called with the mutex held. All other
+	// private methods must only be called with the mutex held.
+	void simulate_call(SimulatedCall call);
+
+	// Blocks while the window is hung. Must not be called with the mutex held either.
+	void wait_while_hung(HWND handle);
+
+	SimulatedWindow& window(HWND handle);
+	void activate(HWND handle);
+	bool set_rect(HWND handle, const Rect& rect);
+
+	// Like Windows, cloaks the windows of the previous desktop and uncloaks those of the new one.
+	void set_current_desktop(const GUID& desktop_id);
+
+	// Like the shell, also focuses the topmost window of the new desktop.
+	void show_desktop(const GUID& desktop_id);
+
+	bool remove(HWND handle);
+	void emit(WindowEventType type, HWND handle);
+	void drain_events(std::vector<WindowEvent>& events);
+
+	mutable std::mutex m_mutex;
+	std::condition_variable m_cv;
+
+	std::unordered_map<HWND, SimulatedWindow> m_windows;
+	std::vector<HWND> m_z_order;
+	HWND m_foreground = nullptr;
+	uintptr_t m_next_handle = 1;
+
+	// Like Windows' foreground lock, only this thread may change the foreground window: the one that receives the
+	// input, i.e. that created the simulation or took the latest message.
+	std::thread::id m_input_thread;
+
+	std::vector<GUID> m_desktops;
+	GUID m_current_desktop = {};
+	std::atomic<bool> m_desktop_manager_available = true;
+
+	Rect m_frame_margin = {
+		{-7.0f, 0.0f},
+		{7.0f,  7.0f}
+	};
+	Rect m_work_area = {
+		{0.0f,    0.0f   },
+		{1920.0f, 1032.0f}
+	};
+
+	std::unordered_map<int, std::pair<UINT, UINT>> m_hotkeys;
+	std::vector<KeyInput> m_sent_input;
+	std::vector<std::vector<HWND>> m_position_batches;
+	std::unordered_set<UINT> m_held_keys;
+	std::deque<Message> m_messages;
+	std::unordered_set<HANDLE> m_signalled;
+	std::unordered_set<HWND> m_hung;
+
+	bool m_has_event_source = false;
+
+	// Signalled on desktop switches while there is a desktop switch source.
+	HANDLE m_desktop_switch_handle = nullptr;
+
+	// Handles of directory change sources and the directories they watch
+	std::unordered_map<HANDLE, std::filesystem::path> m_directory_watches;
+
+	// By handle, which increase, such that the most recent hook comes last.
+	std::map<HANDLE, std::function<bool(const KeyInput&)>> m_keyboard_hooks;
+	std::vector<WindowEvent> m_events;
+
+	std::array<std::atomic<uint64_t>, (size_t)SimulatedCall::Count> m_call_counts = {};
+	std::array<std::atomic<clock::duration::rep>, (size_t)SimulatedCall::Count> m_latencies = {};
+};
+
+} // namespace twm
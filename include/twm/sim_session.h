@@ -0,0 +1,41 @@
+// This file was developed by Thomas Müller <thomas94@gmx.net>.
+// It is published under the GPU GPLv3 license; see LICENSE.txt for details.
+
+#pragma once
+
+#include <twm/common.h>
+#include <twm/hotkey.h>
+#include <twm/platform.h>
+#include <twm/platform_sim.h>
+
+#include <vector>
+
+// Scenarios that twm_test and twm_bench share, such that the tests check the very paths that are benchmarked.
+// Deterministic: the same arguments always result in the same scenario.
+
+namespace twm {
+
+struct SimulatedSession {
+	// Owned by twm's platform, see set_platform, until the next session replaces it
+	SimulatedPlatform* sim = nullptr;
+	std::vector<HWND> handles;
+};
+
+// Starts over with `n_windows` simulated windows scattered over a grid, the first one focused. With multiple
+// virtual desktops, the windows are dealt out to them in turn, and the first desktop is the current one.
+SimulatedSession start_simulated_session(size_t n_windows, size_t n_desktops = 1);
+
+// Distinct keycombos with one to four modifiers, the same ones on each call
+std::vector<Binding> make_hotkey_bindings(size_t n);
+
+struct KeySequenceScenario {
+	// Key sequences of three keys each, such as "alt-a b c", all distinct
+	std::vector<Binding> bindings;
+
+	// The key presses and releases that type each sequence, in the order of `bindings`
+	std::vector<std::vector<KeyInput>> presses;
+};
+
+KeySequenceScenario make_key_sequences(size_t n);
+
+} // namespace twm
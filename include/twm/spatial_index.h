@@ -0,0 +1,58 @@
+// This file was developed by Thomas Müller <thomas94@gmx.net>.
+// It is published under the GPU GPLv3 license; see LICENSE.txt for details.
+
+#pragma once
+
+#include <twm/common.h>
+#include <twm/math.h>
+
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+namespace twm {
+
+// Index of window rects that answers "which window is adjacent to this
+// one in direction D" without looking at every window. Windows are kept
+// sorted by their center along each axis, such that a query only visits
+// windows on the correct side, in order of increasing distance along the
+// axis, and stops as soon as no closer window can follow.
+class SpatialIndex {
+public:
+	using RecencyFn = std::function<clock::time_point(HWND)>;
+
+	// Windows whose distances differ by less than this many pixels are
+	// considered equally close.
+	static constexpr float CLOSENESS_TOLERANCE = 2.0f;
+
+	void set(HWND handle, const Rect& rect);
+	void erase(HWND handle);
+	void clear();
+
+	size_t size() const { return m_rects.size(); }
+	bool empty() const { return m_rects.empty(); }
+
+	// Returns the window adjacent to `handle` in direction `dir`, or nullptr if there is none.
+	// Among the windows that are as close as the closest one (up to CLOSENESS_TOLERANCE), the
+	// one that was most recently interacted with as per `recency` is chosen.
+	HWND adjacent(HWND handle, Direction dir, const RecencyFn& recency) const;
+
+	// Same as `adjacent`, but considers every window. Serves as a reference to check against.
+	HWND adjacent_brute_force(HWND handle, Direction dir, const RecencyFn& recency) const;
+
+private:
+	struct Entry {
+		float key;
+		HWND handle;
+		Rect rect;
+	};
+
+	static bool entry_less(const Entry& a, const Entry& b);
+
+	std::unordered_map<HWND, Rect> m_rects;
+
+	// Entries of all windows sorted by their center along the x and y axis, respectively.
+	std::vector<Entry> m_entries[2];
+};
+
+} // namespace twm
@@ -0,0 +1,55 @@
+// This file was developed by Thomas Müller <thomas94@gmx.net>.
+// It is published under the GPU GPLv3 license; see LICENSE.txt for details.
+
+#pragma once
+
+#include <twm/common.h>
+
+#include <filesystem>
+#include <string>
+#include <string_view>
+
+namespace twm {
+
+// Lightweight tracing of where twm spends its time, e.g. between a hotkey press and the completion of its action.
+// Spans are recorded into a fixed-size ring buffer that only keeps the most recent ones, such that tracing can stay
+// enabled at all times, and are exported in the Chrome trace event format that chrome://tracing and Perfetto display.
+
+struct TraceEvent {
+	// Must be a string literal: only the pointer is stored.
+	const char* name = nullptr;
+	clock::time_point start = {};
+	clock::duration duration = {};
+	uint32_t thread = 0;
+
+	// Free-form context, e.g. the hotkey's action. Truncated to fit.
+	char detail[48] = {};
+};
+
+void trace(const TraceEvent& event);
+void trace(const char* name, clock::time_point start, clock::time_point end, std::string_view detail = {});
+
+// Records the time from its construction to its destruction.
+class TraceSpan {
+public:
+	TraceSpan(const char* name, std::string_view detail = {});
+	~TraceSpan();
+
+	TraceSpan(const TraceSpan& other) = delete;
+	TraceSpan& operator=(const TraceSpan& other) = delete;
+
+private:
+	TraceEvent m_event;
+};
+
+// Chrome trace JSON of all events that are still in the ring buffer, oldest first.
+std::string trace_to_json();
+
+// Where the trace is saved on demand, e.g. from the tray. Defaults to twm_trace.json in the temp directory.
+std::filesystem::path trace_path();
+void set_trace_path(const std::filesystem::path& path);
+
+// Throws runtime_error if the file could not be written.
+void save_trace(const std::filesystem::path& path);
+
+} // namespace twm
@@ -5,20 +5,40 @@
 
 #include <twm/common.h>
 
+#include <atomic>
+#include <thread>
+
 namespace twm {
 
+// twm's icon in the notification area, whose menu, among other things, exits twm by posting WM_QUIT to the thread
+// that created it. Lives on its own thread, such that twm does not wait for the shell, which may take a while to
+// respond, especially at login. Failing to add the icon is logged rather than thrown.
 class TrayPresence {
 public:
 	TrayPresence(HINSTANCE instance);
 	~TrayPresence();
 
+	TrayPresence(const TrayPresence& other) = delete;
+	TrayPresence& operator=(const TrayPresence& other) = delete;
+
 private:
 	static const uint32_t WM_TRAYICON_MSG = WM_APP + 1;
 
 	static LRESULT CALLBACK tray_window_proc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam);
 
+	void run(HINSTANCE instance, DWORD owner_thread_id);
+
+	// Throw on failure. `remove_icon` cleans up after partial success, too.
+	void add_icon(HINSTANCE instance);
+	void remove_icon();
+
 	HWND m_invisible_window = nullptr;
+	bool m_icon_added = false;
 	uint32_t m_uid;
+
+	std::thread m_thread;
+	DWORD m_thread_id = 0;
+	std::atomic<bool> m_stopping = false;
 };
 
 } // namespace twm
@@ -0,0 +1,130 @@
+// This file was developed by Thomas Müller <thomas94@gmx.net>.
+// It is published under the GPU GPLv3 license; see LICENSE.txt for details.
+
+#pragma once
+
+#include <twm/common.h>
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace twm {
+
+// A few threads that make calls on behalf of a caller that can't afford to wait for them indefinitely,
+// such as calls into other processes' windows, which block for as long as those processes are hung.
+// Workers that are stuck in a call past its deadline are replaced, such that `n_threads` of them remain
+// for other calls no matter how many calls hang. Once a stuck worker's call returns, the worker retires.
+class WorkerPool {
+public:
+	WorkerPool(size_t n_threads);
+
+	// Joins the workers, so it must not be destroyed while one of them is stuck in a call.
+	~WorkerPool();
+
+	WorkerPool(const WorkerPool& other) = delete;
+	WorkerPool& operator=(const WorkerPool& other) = delete;
+
+	// Runs `fn` on a worker and waits until it returns or `deadline` passes, whichever comes first. Returns the
+	// result of `fn`, or nothing if the deadline passed. `fn` is dropped if no worker got to it by then. If it
+	// was already running, its worker is replaced, `on_hang` is called right away, and `on_late_return` is called
+	// on the worker once `fn` returns. Exceptions thrown by `fn` are rethrown to the caller.
+	template <typename T>
+	std::optional<T> run(
+		std::function<T()> fn,
+		clock::time_point deadline,
+		std::function<void()> on_hang = {},
+		std::function<void()> on_late_return = {}
+	) {
+		struct Call {
+			std::mutex mutex;
+			std::condition_variable cv;
+			std::optional<T> result;
+			std::exception_ptr error;
+			bool started = false;
+			bool done = false;
+			bool abandoned = false;
+		};
+
+		// Shared with the worker, which may outlive the caller's interest in it.
+		auto call = std::make_shared<Call>();
+		push([this, call, fn = std::move(fn), on_late_return = std::move(on_late_return)]() {
+			{
+				std::lock_guard lock{call->mutex};
+				if (call->abandoned) {
+					return;
+				}
+
+				call->started = true;
+			}
+
+			std::optional<T> result;
+			std::exception_ptr error;
+			try {
+				result = fn();
+			} catch (...) {
+				error = std::current_exception();
+			}
+
+			std::lock_guard lock{call->mutex};
+			call->result = std::move(result);
+			call->error = error;
+			call->done = true;
+			if (!call->abandoned) {
+				call->cv.notify_one();
+				return;
+			}
+
+			unstick_worker();
+			if (on_late_return) {
+				on_late_return();
+			}
+		});
+
+		std::unique_lock lock{call->mutex};
+		if (!call->cv.wait_until(lock, deadline, [&]() { return call->done; })) {
+			call->abandoned = true;
+			if (call->started) {
+				replace_stuck_worker();
+				if (on_hang) {
+					on_hang();
+				}
+			}
+
+			return {};
+		}
+
+		if (call->error) {
+			std::rethrow_exception(call->error);
+		}
+
+		return std::move(call->result);
+	}
+
+private:
+	void push(std::function<void()> task);
+	void work();
+
+	// Called when a worker's call missed its deadline and when it returned after all, respectively.
+	void replace_stuck_worker();
+	void unstick_worker();
+
+	std::mutex m_mutex;
+	std::condition_variable m_cv;
+	std::deque<std::function<void()>> m_tasks;
+	bool m_stopping = false;
+
+	// Workers that are not stuck. More than this many only while a stuck worker returns and retires.
+	size_t m_n_threads;
+	size_t m_n_stuck = 0;
+
+	std::vector<std::thread> m_threads;
+};
+
+} // namespace twm
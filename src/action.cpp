@@ -0,0 +1,139 @@
+// This file was developed by Thomas Müller <thomas94@gmx.net>.
+// It is published under the GPU GPLv3 license; see LICENSE.txt for details.
+
+#include <twm/action.h>
+#include <twm/common.h>
+
+#include <algorithm>
+#include <format>
+
+using namespace std;
+
+namespace twm {
+
+Action to_action(string_view str) {
+	auto lstr = to_lower(str);
+	if (lstr == "focus") {
+		return Action::Focus;
+	} else if (lstr == "swap") {
+		return Action::Swap;
+	} else if (lstr == "move_to_desktop") {
+		return Action::MoveToDesktop;
+	} else if (lstr == "close") {
+		return Action::Close;
+	} else if (lstr == "terminate") {
+		return Action::Terminate;
+	} else if (lstr == "reload") {
+		return Action::Reload;
+	}
+
+	throw runtime_error{format("Invalid action: {}", str)};
+}
+
+Target to_target(string_view str) {
+	auto lstr = to_lower(str);
+	if (lstr == "window") {
+		return Target::Window;
+	} else if (lstr == "desktop") {
+		return Target::Desktop;
+	}
+
+	throw runtime_error{format("Invalid target: {}", str)};
+}
+
+Command parse_command(string_view str) {
+	auto parts = split(trim(str), " ");
+	if (parts.size() < 1) {
+		throw runtime_error{"Invalid action. Must be of the form <focus|swap|move_to_desktop|close|terminate|reload>"};
+	}
+
+	Command cmd = {};
+	cmd.action = to_action(parts[0]);
+	switch (cmd.action) {
+		case Action::Focus: {
+			if (parts.size() != 3) {
+				throw runtime_error{
+					"Invalid focus. Syntax: focus <window|desktop> <top|bottom|left|right> or focus desktop <number>"
+				};
+			}
+
+			cmd.target = to_target(parts[1]);
+
+			// Desktops are numbered from 1, like in the task view.
+			const auto& arg = parts[2];
+			bool is_number = !arg.empty() && arg.size() <= 3 && all_of(arg.begin(), arg.end(), [](char c) {
+				return c >= '0' && c <= '9';
+			});
+
+			if (cmd.target == Target::Desktop && is_number) {
+				cmd.desktop_index = stoi(arg) - 1;
+				if (cmd.desktop_index < 0) {
+					throw runtime_error{"Invalid focus. Desktops are numbered from 1"};
+				}
+
+				break;
+			}
+
+			cmd.direction = to_direction(parts[2]);
+			if (cmd.target == Target::Desktop && cmd.direction != Direction::Left && cmd.direction != Direction::Right) {
+				throw runtime_error{"Invalid focus. Desktops can only be focused left or right"};
+			}
+		} break;
+		case Action::Swap: {
+			if (parts.size() != 3) {
+				throw runtime_error{"Invalid swap. Syntax: swap <window|desktop> <top|bottom|left|right>"};
+			}
+
+			cmd.target = to_target(parts[1]);
+			cmd.direction = to_direction(parts[2]);
+			if (cmd.target == Target::Desktop) {
+				throw runtime_error{"Cannot swap desktops"};
+			}
+		} break;
+		case Action::MoveToDesktop: {
+			if (parts.size() != 3) {
+				throw runtime_error{"Invalid move_to_desktop. Syntax: move_to_desktop <window|desktop> <left|right>"};
+			}
+
+			cmd.target = to_target(parts[1]);
+			cmd.direction = to_direction(parts[2]);
+			if (cmd.target == Target::Desktop) {
+				throw runtime_error{"Cannot move desktops"};
+			}
+
+			if (cmd.direction != Direction::Left && cmd.direction != Direction::Right) {
+				throw runtime_error{"Invalid move_to_desktop. Windows can only be moved to the left or right desktop"};
+			}
+		} break;
+		case Action::Close: {
+			if (parts.size() != 2) {
+				throw runtime_error{"Invalid close. Syntax: close window"};
+			}
+
+			cmd.target = to_target(parts[1]);
+			if (cmd.target == Target::Desktop) {
+				throw runtime_error{"Cannot close desktops"};
+			}
+		} break;
+		case Action::Terminate: {
+			if (parts.size() != 2) {
+				throw runtime_error{"Invalid terminate. Syntax: terminate window"};
+			}
+
+			cmd.target = to_target(parts[1]);
+			if (cmd.target == Target::Desktop) {
+				throw runtime_error{"Cannot terminate desktops"};
+			}
+		} break;
+		case Action::Reload: {
+			if (parts.size() != 1) {
+				throw runtime_error{"Invalid reload. Syntax: reload"};
+			}
+		} break;
+		default: throw runtime_error{format("Invalid action: {}", str)};
+	}
+
+	return cmd;
+}
+
+} // namespace twm
@@ -0,0 +1,529 @@
+// This file was developed by Thomas Müller <thomas94@gmx.net>.
+// It is published under the GPU GPLv3 license; see LICENSE.txt for details.
+
+#include <twm/action.h>
+#include <twm/app.h>
+#include <twm/common.h>
+#include <twm/config.h>
+#include <twm/desktop.h>
+#include <twm/events.h>
+#include <twm/input.h>
+#include <twm/logging.h>
+#include <twm/loop.h>
+#include <twm/platform.h>
+#include <twm/trace.h>
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <future>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+namespace twm {
+
+void save_config_to_appdata() {
+	if (char* appdata = getenv("APPDATA")) {
+		if (filesystem::exists(appdata)) {
+			log_info("Saving config to {}\\twm\\twm.toml", appdata);
+
+			auto config_dir = filesystem::path{appdata} / "twm";
+			try {
+				filesystem::create_directories(config_dir);
+				auto config_path = filesystem::path{appdata} / "twm" / "twm.toml";
+				ofstream f{config_path};
+				cfg.save(f);
+			} catch (const filesystem::filesystem_error& e) {
+				log_error("Failed to save config: {}", e.what());
+			}
+		}
+	}
+}
+
+optional<filesystem::path> find_config() {
+	// Try the following configs in order of priority:
+	// 1. twm.toml in the current working directory
+	// 2. TWM_CONFIG_PATH environment variable
+	// 3. %APPDATA%\twm\twm.toml
+
+	filesystem::path config_path = "twm.toml";
+	if (!filesystem::exists(config_path)) {
+		if (char* env_config_path = getenv("TWM_CONFIG_PATH")) {
+			config_path = env_config_path;
+		}
+	}
+
+	if (!filesystem::exists(config_path)) {
+		if (char* appdata = getenv("APPDATA")) {
+			config_path = filesystem::path{appdata} / "twm" / "twm.toml";
+		}
+	}
+
+	if (!filesystem::exists(config_path)) {
+		return {};
+	}
+
+	return config_path;
+}
+
+// Serves the key sequences while it exists, such that reloads can reach it
+KeySequences* key_sequences = nullptr;
+
+// Brings the platform in line with the config after it was (re-)loaded.
+void apply_config() {
+	set_window_call_timeout(cfg.window_call_timeout());
+
+	// Styling settings may have changed. Make sure they are re-applied in full.
+	invalidate_all_window_attributes();
+
+	if (cfg.disable_drop_shadows) {
+		set_system_dropshadow(false);
+	}
+
+	if (key_sequences) {
+		key_sequences->update();
+	}
+}
+
+void load_config(shared_ptr<const ParsedConfig> parsed) {
+	if (!parsed) {
+		// If there is none, fall back to the default config (and maybe save it to %APPDATA%\twm\twm.toml)
+		log_info("No config file found. Using default config.");
+		cfg.load_default();
+		apply_config();
+		// save_config_to_appdata();
+		return;
+	}
+
+	cfg.load(*parsed);
+	apply_config();
+}
+
+void reload() {
+	auto config_path = find_config();
+	if (config_path) {
+		log_info("Loading config from {}", config_path->string());
+	}
+
+	load_config(config_path ? parse_config_file(*config_path) : nullptr);
+}
+
+future<shared_ptr<const ParsedConfig>> parse_config_async() {
+	// Finding the config hits the disk, too.
+	return async(launch::async, []() -> shared_ptr<const ParsedConfig> {
+		auto config_path = find_config();
+		if (!config_path) {
+			return nullptr;
+		}
+
+		log_info("Loading config from {}", config_path->string());
+		return parse_config_file(*config_path);
+	});
+}
+
+// Long enough to span the writes that make up a single save, short enough for the reload to feel immediate.
+const auto CONFIG_DEBOUNCE = chrono::milliseconds{100};
+
+ConfigWatcher::ConfigWatcher(EventLoop& loop, const filesystem::path& path) :
+	m_loop{loop}, m_path{path}, m_stamp{stamp(path)} {
+	auto dir = path.parent_path();
+	m_source = platform().create_directory_change_source(dir.empty() ? filesystem::path{"."} : dir);
+	m_loop.add_handle(m_source->handle(), [this]() { on_change(); });
+}
+
+ConfigWatcher::~ConfigWatcher() {
+	m_loop.remove_handle(m_source->handle());
+	if (m_parser.joinable()) {
+		m_parser.join();
+	}
+}
+
+ConfigWatcher::FileStamp ConfigWatcher::stamp(const filesystem::path& path) {
+	error_code time_ec, size_ec;
+	FileStamp result = {filesystem::last_write_time(path, time_ec), filesystem::file_size(path, size_ec)};
+	return time_ec || size_ec ? FileStamp{} : result;
+}
+
+void ConfigWatcher::on_change() {
+	m_source->rearm();
+
+	// Other files in the same directory are of no interest.
+	if (auto s = stamp(m_path); s == m_stamp) {
+		return;
+	} else {
+		m_stamp = s;
+	}
+
+	// Every further change pushes the reload back. Tasks can't be rescheduled, so check when the task runs.
+	m_reload_time = clock::now() + CONFIG_DEBOUNCE;
+	if (!m_reload_scheduled) {
+		m_reload_scheduled = true;
+		schedule_reload();
+	}
+}
+
+void ConfigWatcher::schedule_reload() {
+	m_loop.schedule(m_reload_time, [this, alive = weak_ptr{m_alive}]() {
+		if (!alive.lock()) {
+			return;
+		}
+
+		if (clock::now() < m_reload_time) {
+			schedule_reload();
+			return;
+		}
+
+		m_reload_scheduled = false;
+		if (m_parsing) {
+			m_parse_again = true;
+		} else {
+			parse();
+		}
+	});
+}
+
+void ConfigWatcher::parse() {
+	m_parsing = true;
+	if (m_parser.joinable()) {
+		m_parser.join();
+	}
+
+	m_parser = thread{[this, alive = weak_ptr{m_alive}, path = m_path]() {
+		shared_ptr<const ParsedConfig> parsed;
+		string error;
+		try {
+			parsed = parse_config_file(path);
+		} catch (const runtime_error& e) {
+			error = e.what();
+		}
+
+		m_loop.post([this, alive, parsed, error]() {
+			if (alive.lock()) {
+				on_parsed(parsed, error);
+			}
+		});
+	}};
+}
+
+void ConfigWatcher::on_parsed(shared_ptr<const ParsedConfig> parsed, const string& error) {
+	m_parsing = false;
+
+	if (!parsed) {
+		log_warning("Keeping the current config, because {} failed to parse: {}", m_path.string(), error);
+	} else {
+		try {
+			cfg.load(*parsed);
+			apply_config();
+			Desktop::update_all();
+			Desktop::update_tiling();
+
+			++m_n_reloads;
+			log_info("Reloaded config from {}", m_path.string());
+		} catch (const runtime_error& e) {
+			log_warning("Failed to reload config: {}", e.what());
+		}
+	}
+
+	// Changed while parsing
+	if (m_parse_again) {
+		m_parse_again = false;
+		parse();
+	}
+}
+
+void invoke_action(const Command& cmd) {
+	switch (cmd.action) {
+		case Action::Focus: {
+			switch (cmd.target) {
+				case Target::Window: Window::focus_adjacent_or_default(cmd.direction); break;
+				case Target::Desktop: {
+					if (cmd.desktop_index >= 0) {
+						Desktop::focus_index((size_t)cmd.desktop_index);
+					} else {
+						Desktop::focus_adjacent(cmd.direction);
+					}
+				} break;
+			}
+		} break;
+		case Action::Swap: Window::swap_adjacent(cmd.direction); break;
+		case Action::MoveToDesktop: Window::move_to_adjacent_desktop(cmd.direction); break;
+		case Action::Close: {
+			if (auto* w = Window::focused()) {
+				w->close();
+			}
+		} break;
+		case Action::Terminate: {
+			if (auto* w = Window::focused()) {
+				w->terminate();
+			}
+		} break;
+		case Action::Reload: {
+			reload();
+			Desktop::update_all();
+			Desktop::update_tiling();
+		} break;
+	}
+}
+
+void apply_window_events(WindowEventSource* window_events) {
+	if (!window_events) {
+		return;
+	}
+
+	static vector<WindowEvent> events;
+	window_events->drain(events);
+	for (const auto& e : events) {
+		try {
+			Desktop::apply(e);
+		} catch (const runtime_error& err) {
+			// The window may have disappeared while we were still processing its events.
+			log_debug("Failed to apply window event: {}", err.what());
+		}
+	}
+
+	events.clear();
+}
+
+void track_current_desktop(EventLoop& loop, DesktopSwitchSource* desktop_switches) {
+	Desktop::tracks_current_id() = desktop_switches != nullptr;
+	if (!desktop_switches) {
+		return;
+	}
+
+	Desktop::set_current_id(desktop_switches->current_desktop());
+	loop.add_handle(desktop_switches->handle(), [desktop_switches]() {
+		desktop_switches->rearm();
+		Desktop::set_current_id(desktop_switches->current_desktop());
+	});
+}
+
+// Whether all windows were taken stock of since startup. Window events only report changes.
+bool took_stock = false;
+
+void take_stock() {
+	TraceSpan span{"startup", "first_update"};
+	Desktop::update_all();
+	took_stock = true;
+}
+
+void schedule_first_update(EventLoop& loop) {
+	loop.schedule_in(clock::duration::zero(), []() {
+		// A hotkey may have needed it first.
+		if (!took_stock) {
+			take_stock();
+		}
+	});
+}
+
+void schedule_update(EventLoop& loop, bool has_window_events) {
+	// With window events, the full update only serves to reconcile state that
+	// the events may have missed and can therefore run much less frequently.
+	auto interval = has_window_events ? cfg.reconcile_interval() : cfg.update_interval();
+
+	static auto prev_desktop_stats = virtual_desktop_stats();
+	static auto prev_time = clock::now();
+	loop.schedule_in(interval, [&loop, has_window_events]() {
+		auto prev_stats = dwm_attribute_stats();
+		Desktop::update_all();
+
+		auto stats = dwm_attribute_stats();
+		log_debug(
+			"Update issued {} DWM attribute calls, suppressed {}, and skipped {} for unresponsive windows.",
+			stats.n_issued - prev_stats.n_issued,
+			stats.n_suppressed - prev_stats.n_suppressed,
+			stats.n_skipped - prev_stats.n_skipped
+		);
+
+		// Since the previous update, including everything in between, e.g. hotkeys and window events.
+		auto desktop_stats = virtual_desktop_stats();
+		auto now = clock::now();
+		log_debug(
+			"{:.1f} virtual desktop COM round trips/s. {} desktop queries were answered from cache.",
+			(desktop_stats.n_queries - prev_desktop_stats.n_queries) / chrono::duration<double>(now - prev_time).count(),
+			desktop_stats.n_cached - prev_desktop_stats.n_cached
+		);
+
+		prev_desktop_stats = desktop_stats;
+		prev_time = now;
+
+		schedule_update(loop, has_window_events);
+	});
+}
+
+// When twm started, until the first hotkey was served
+optional<clock::time_point> startup_time;
+
+StartupTimeline::StartupTimeline() : m_start{clock::now()}, m_phase_start{m_start} {}
+
+void StartupTimeline::end_phase(const char* name) {
+	auto now = clock::now();
+	trace("startup", m_phase_start, now, name);
+	m_phases.emplace_back(name, now - m_phase_start);
+	m_phase_start = now;
+}
+
+void StartupTimeline::ready() {
+	vector<string> phases;
+	for (const auto& [name, duration] : m_phases) {
+		phases.emplace_back(format("{} {:.1f} ms", name, chrono::duration<double, milli>(duration).count()));
+	}
+
+	log_info(
+		"Ready to serve hotkeys {:.1f} ms after startup: {}",
+		chrono::duration<double, milli>(clock::now() - m_start).count(),
+		join(phases, ", ")
+	);
+
+	startup_time = m_start;
+}
+
+// Serves a hotkey or key sequence that was pressed at `posted`. Takes a copy of the command, because a reload
+// invalidates the bindings that it comes from.
+void serve(
+	EventLoop& loop, WindowEventSource* window_events, clock::time_point posted, Command command, string_view action
+) {
+	// The action's name comes from those bindings, too, but only needs copying if the action itself reloads them.
+	string reload_action;
+	if (command.action == Action::Reload) {
+		reload_action = action;
+		action = reload_action;
+	}
+
+	// The posting time may be coarser than our clock and must not end up after the receipt.
+	auto received = clock::now();
+	posted = std::min(posted, received);
+	trace("hotkey_queued", posted, received);
+
+	log_debug(
+		"Hotkey dispatched {} ms after it was posted. {:.1f} wakeups/s since the previous hotkey.",
+		chrono::duration_cast<chrono::milliseconds>(received - posted).count(),
+		loop.stats().wakeups_per_second()
+	);
+	loop.stats().reset();
+
+	// Ensure our information about desktops and their contained windows is as up-to-date as
+	// possible before triggering a hotkey to minimize potential for erroneous behavior. With
+	// window events, only what the action needs must be refreshed. Without, we need a full update, as we do for
+	// hotkeys that are served before the first one took place.
+	auto start = clock::now();
+	{
+		TraceSpan span{"hotkey_refresh"};
+		apply_window_events(window_events);
+		if (!took_stock) {
+			take_stock();
+		} else if (window_events) {
+			Desktop::refresh_for_action();
+		} else {
+			Desktop::update_all();
+		}
+	}
+
+	auto refreshed = clock::now();
+
+	log_debug("Invoking action: {}", action);
+	{
+		TraceSpan span{"hotkey_action", action};
+		invoke_action(command);
+	}
+
+	auto end = clock::now();
+	trace("hotkey", posted, end, action);
+
+	log_debug(
+		"Hotkey handled in {:.2f} ms, of which {:.2f} ms refreshing windows.",
+		chrono::duration<double, milli>(end - start).count(),
+		chrono::duration<double, milli>(refreshed - start).count()
+	);
+
+	if (startup_time) {
+		// Hotkeys that are pressed during startup wait for it to finish, which the second figure shows.
+		log_info(
+			"First hotkey served {:.1f} ms after startup and {:.1f} ms after it was pressed.",
+			chrono::duration<double, milli>(end - *startup_time).count(),
+			chrono::duration<double, milli>(end - posted).count()
+		);
+
+		trace("startup_first_hotkey", *startup_time, end, action);
+		startup_time.reset();
+	}
+}
+
+KeySequences::KeySequences(EventLoop& loop, WindowEventSource* window_events) :
+	m_loop{loop}, m_window_events{window_events} {
+	key_sequences = this;
+	update();
+}
+
+void KeySequences::set_window_events(WindowEventSource* window_events) { m_window_events = window_events; }
+
+KeySequences::~KeySequences() {
+	key_sequences = nullptr;
+	if (m_engine) {
+		m_loop.remove_handle(m_engine->handle());
+	}
+}
+
+void KeySequences::update() {
+	if (!cfg.key_matcher) {
+		if (m_engine) {
+			m_loop.remove_handle(m_engine->handle());
+			m_engine.reset();
+			log_debug("Unhooked the keyboard: no key sequences");
+		}
+
+		return;
+	}
+
+	if (!m_engine) {
+		try {
+			m_engine = make_unique<InputEngine>();
+		} catch (const runtime_error& e) {
+			log_warning("Key sequences unavailable: {}", e.what());
+			return;
+		}
+
+		m_loop.add_handle(m_engine->handle(), [this]() {
+			m_engine->drain([this](const Command& command, clock::time_point pressed) {
+				serve(m_loop, m_window_events, pressed, command, "key sequence");
+			});
+		});
+	}
+
+	m_engine->set_matcher(cfg.key_matcher);
+}
+
+bool tick(EventLoop& loop, WindowEventSource* window_events) {
+	bool keep_running = loop.run_once([&](const Message& msg) {
+		switch (msg.type) {
+			case MessageType::Hotkey: {
+				const Hotkey* hotkey = cfg.hotkeys.find(msg.hotkey_id);
+				if (!hotkey) {
+					log_debug("Ignoring hotkey {}: it was removed by a reload after being pressed.", msg.hotkey_id);
+					break;
+				}
+
+				serve(loop, window_events, msg.posted, hotkey->command, hotkey->action);
+			} break;
+			case MessageType::Quit: {
+				log_debug("Received WM_QUIT/CLOSE/DESTROY. Exiting...");
+				return false;
+			} break;
+			default: {
+				log_debug("PeekMessage: unknown message ID {}", msg.raw_id);
+			} break;
+		}
+
+		return true;
+	});
+
+	apply_window_events(window_events);
+	return keep_running;
+}
+
+} // namespace twm
@@ -0,0 +1,708 @@
+// This file was developed by Thomas Müller <thomas94@gmx.net>.
+// It is published under the GPU GPLv3 license; see LICENSE.txt for details.
+
+// Microbenchmarks of twm's hot paths against the simulated platform. Prints
+// one JSON document with a result per benchmark and window count. Each result
+// also holds the number of platform calls per iteration by category, which,
+// unlike timings, carries over to the real Windows API one-to-one.
+//
+// Usage: twm_bench [--filter <substring>] [--max-windows <n>] [--latency] [--out <path>] [--trace <path>]
+//
+// --latency gives platform calls rough, assumed costs (see `apply_latencies`)
+// instead of none, such that their share of the time becomes visible.
+//
+// --trace saves the trace spans of the last iterations, see trace.h.
+//
+// Checks of whether the optimized paths get the right results live in test.cpp.
+
+#include <twm/action.h>
+#include <twm/app.h>
+#include <twm/bsp.h>
+#include <twm/common.h>
+#include <twm/config.h>
+#include <twm/desktop.h>
+#include <twm/hotkey.h>
+#include <twm/input.h>
+#include <twm/logging.h>
+#include <twm/loop.h>
+#include <twm/platform.h>
+#include <twm/platform_sim.h>
+#include <twm/sim_session.h>
+#include <twm/spatial_index.h>
+#include <twm/trace.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+using namespace twm;
+
+namespace {
+
+const size_t WINDOW_COUNTS[] = {10, 100, 1000, 10000};
+
+// Some users spread their windows over 20 and more virtual desktops.
+const size_t DESKTOP_COUNTS[] = {1, 4, 24};
+
+// Each benchmark runs for at least this long, but no fewer than MIN_ITERATIONS times.
+const auto TARGET_DURATION = chrono::milliseconds{200};
+const size_t MIN_ITERATIONS = 5;
+const size_t MAX_ITERATIONS = 100000;
+
+const char* CALL_NAMES[] = {
+	"window_query",
+	"window_text",
+	"dwm",
+	"positioning",
+	"window_action",
+	"virtual_desktop",
+	"input",
+};
+
+static_assert(size(CALL_NAMES) == (size_t)SimulatedCall::Count);
+
+struct Result {
+	string name;
+	size_t n_windows = 0;
+	size_t n_desktops = 1;
+	size_t iterations = 0;
+	double min_ns = 0, median_ns = 0, mean_ns = 0, p95_ns = 0;
+	array<double, (size_t)SimulatedCall::Count> calls_per_iteration = {};
+};
+
+struct Options {
+	string filter;
+	size_t max_windows = 10000;
+	bool latency = false;
+	string out;
+	string trace;
+};
+
+Options opts;
+SimulatedPlatform* sim = nullptr;
+size_t n_desktops = 1;
+vector<Result> results;
+
+void apply_latencies() {
+	if (!opts.latency) {
+		return;
+	}
+
+	// Ballpark figures, not measurements. Cross-process calls (titles, COM) and
+	// compositor round trips cost orders of magnitude more than local queries.
+	sim->set_latency(SimulatedCall::WindowQuery, chrono::nanoseconds{500});
+	sim->set_latency(SimulatedCall::WindowText, chrono::microseconds{5});
+	sim->set_latency(SimulatedCall::Dwm, chrono::microseconds{20});
+	sim->set_latency(SimulatedCall::Positioning, chrono::microseconds{100});
+	sim->set_latency(SimulatedCall::WindowAction, chrono::microseconds{50});
+	sim->set_latency(SimulatedCall::VirtualDesktop, chrono::microseconds{15});
+	sim->set_latency(SimulatedCall::Input, chrono::microseconds{10});
+}
+
+// Starts over, see start_simulated_session, with the latencies that were asked for.
+vector<HWND> reset(size_t n_windows, size_t desktops = 1) {
+	auto session = start_simulated_session(n_windows, desktops);
+	sim = session.sim;
+	n_desktops = desktops;
+	apply_latencies();
+	return session.handles;
+}
+
+bool enabled(const string& name) { return name.find(opts.filter) != string::npos; }
+
+template <typename F> void measure(const string& name, size_t n_windows, F&& fn) {
+	if (!enabled(name)) {
+		return;
+	}
+
+	// Warm up caches (both the CPU's and twm's)
+	fn();
+
+	sim->reset_call_counts();
+
+	vector<double> times;
+	auto start = clock::now();
+	while (times.size() < MAX_ITERATIONS && (times.size() < MIN_ITERATIONS || clock::now() - start < TARGET_DURATION)) {
+		auto t = clock::now();
+		fn();
+		times.emplace_back((double)chrono::duration_cast<chrono::nanoseconds>(clock::now() - t).count());
+	}
+
+	Result result = {
+		.name = name,
+		.n_windows = n_windows,
+		.n_desktops = n_desktops,
+		.iterations = times.size(),
+	};
+	for (size_t i = 0; i < (size_t)SimulatedCall::Count; ++i) {
+		result.calls_per_iteration[i] = (double)sim->call_count((SimulatedCall)i) / times.size();
+	}
+
+	sort(times.begin(), times.end());
+	result.min_ns = times.front();
+	result.median_ns = times[times.size() / 2];
+	result.p95_ns = times[min(times.size() - 1, times.size() * 95 / 100)];
+
+	double sum = 0;
+	for (double t : times) {
+		sum += t;
+	}
+
+	result.mean_ns = sum / times.size();
+
+	cerr << format(
+		"{:>34} {:>6} windows {:>3} desktops: {:>12.0f} ns median\n", name, n_windows, n_desktops, result.median_ns
+	);
+	results.emplace_back(std::move(result));
+}
+
+const Direction DIRECTIONS[] = {Direction::Up, Direction::Down, Direction::Left, Direction::Right};
+
+void bench_desktop(size_t n_windows) {
+	auto handles = reset(n_windows);
+
+	measure("update_all", n_windows, []() { Desktop::update_all(); });
+	measure("refresh_for_action", n_windows, []() { Desktop::refresh_for_action(); });
+
+	size_t i = 0;
+	measure("get_adjacent_window", n_windows, [&]() {
+		HWND h = handles[i % handles.size()];
+		Direction dir = DIRECTIONS[i++ % 4];
+		if (auto* desktop = Desktop::get(h)) {
+			desktop->get_adjacent_window(h, dir);
+		}
+	});
+
+	// Command parsing happens when loading the config. Dispatch alone is what a hotkey costs.
+	Command focus = parse_command("focus window right");
+	measure("invoke_action_focus", n_windows, [&]() { invoke_action(focus); });
+
+	Command swap = parse_command("swap window left");
+	measure("invoke_action_swap", n_windows, [&]() { invoke_action(swap); });
+
+	// Single moves through the frame margin cache. Alternates between two
+	// rects, such that every iteration actually moves the window.
+	if (auto* w = Window::focused()) {
+		Rect a = w->rect(), b = a + Rect{Vec2{10.0f}, Vec2{10.0f}};
+		bool flip = false;
+		measure("window_set_rect", n_windows, [&]() { w->set_rect((flip = !flip) ? b : a); });
+	}
+}
+
+// Full updates with and without caching which desktop each window is on. Run with --latency to see what the
+// saved COM round trips are worth.
+void bench_desktop_id_cache(const vector<HWND>& handles) {
+	measure("update_all_desktop_ids_queried", handles.size(), []() { Desktop::update_all(); });
+
+	set_desktop_id_caching(true);
+	auto window_events = platform().create_window_event_source();
+	Desktop::update_all();
+
+	measure("update_all_desktop_ids_cached", handles.size(), []() { Desktop::update_all(); });
+
+	// With desktop switch notifications, nothing is left to query: the current desktop need not be inferred.
+	auto desktop_switches = platform().create_desktop_switch_source();
+	{
+		EventLoop loop;
+		track_current_desktop(loop, desktop_switches.get());
+		measure("update_all_current_desktop_tracked", handles.size(), []() { Desktop::update_all(); });
+
+		track_current_desktop(loop, nullptr);
+	}
+
+	desktop_switches = nullptr;
+	window_events = nullptr;
+	set_desktop_id_caching(false);
+}
+
+// Lookups of a window's desktop, which every action does several times, as the windows spread over more desktops.
+void bench_desktops(size_t n_windows) {
+	for (size_t desktops : DESKTOP_COUNTS) {
+		auto handles = reset(n_windows, desktops);
+
+		size_t i = 0;
+		measure("desktop_get", n_windows, [&]() { Desktop::get(handles[i++ % handles.size()]); });
+		measure("window_focused", n_windows, []() { Window::focused(); });
+
+		Command focus = parse_command("focus window right");
+		measure("invoke_action_focus_multi_desktop", n_windows, [&]() { invoke_action(focus); });
+
+		bench_desktop_id_cache(handles);
+	}
+}
+
+// Switching to the adjacent desktop and back, from the action until twm knows the new desktop to be current and
+// focused. Once through the shell's desktop manager and once through its keyboard shortcuts, which the simulation
+// applies right away, unlike the shell.
+void bench_desktop_switch(size_t n_windows) {
+	for (bool direct : {true, false}) {
+		string name = direct ? "desktop_switch_direct" : "desktop_switch_keystrokes";
+		if (!enabled(name)) {
+			continue;
+		}
+
+		reset(n_windows, 4);
+		sim->set_desktop_manager_available(direct);
+
+		// Without the desktop manager, the first switch warns, which would end up in the middle of the JSON.
+		auto prev_severity = min_severity;
+		min_severity = Severity::Error;
+
+		Command right = parse_command("focus desktop right"), left = parse_command("focus desktop left");
+		size_t i = 0;
+		measure(name, n_windows, [&]() { invoke_action(i++ % 2 == 0 ? right : left); });
+		min_severity = prev_severity;
+	}
+}
+
+void bench_hotkeys(size_t n_windows) {
+	// End-to-end: from the hotkey message being posted to the action being done. Once with
+	// window events, which only refresh what the action needs, and once with a full update.
+	for (bool with_events : {true, false}) {
+		string name = with_events ? "hotkey_with_window_events" : "hotkey_with_full_update";
+		if (!enabled(name)) {
+			continue;
+		}
+
+		// Back and forth, such that every hotkey ends in focusing a window, rather than running out of windows.
+		reset(n_windows);
+		cfg.hotkeys.add("alt-l", "focus window right");
+		cfg.hotkeys.add("alt-h", "focus window left");
+		int ids[] = {cfg.hotkeys.hotkeys()[0].id, cfg.hotkeys.hotkeys()[1].id};
+
+		unique_ptr<WindowEventSource> window_events;
+		if (with_events) {
+			window_events = platform().create_window_event_source();
+		}
+
+		EventLoop loop;
+		size_t i = 0;
+		measure(name, n_windows, [&]() {
+			sim->post_hotkey(ids[i++ % 2]);
+			tick(loop, window_events.get());
+		});
+	}
+
+	// The same through the keyboard hook: from the last key of a sequence to the action being done.
+	const string name = "key_sequence_with_window_events";
+	if (!enabled(name)) {
+		return;
+	}
+
+	reset(n_windows);
+	cfg.sequences = {
+		{"alt-space l", "focus window right"}
+	};
+	cfg.key_matcher = make_shared<KeyMatcher>(cfg.sequences, cfg.modes);
+
+	auto window_events = platform().create_window_event_source();
+	EventLoop loop;
+	KeySequences key_sequences{loop, window_events.get()};
+	measure(name, n_windows, [&]() {
+		for (KeyInput key : {
+				 KeyInput{VK_LMENU, false},
+				 KeyInput{VK_SPACE, false},
+				 KeyInput{VK_SPACE, true},
+				 KeyInput{VK_LMENU, true},
+				 KeyInput{'L', false},
+				 KeyInput{'L', true},
+			 }) {
+			sim->simulate_key(key);
+		}
+
+		tick(loop, window_events.get());
+	});
+}
+
+// The window that a hotkey focuses stops responding. The first hotkey gives up on the hung call after the timeout,
+// which the warm-up takes, and later ones fail right away.
+void bench_hung_window(size_t n_windows) {
+	const string name = "hotkey_with_hung_window";
+	if (!enabled(name)) {
+		return;
+	}
+
+	reset(n_windows);
+	cfg.hotkeys.add("alt-l", "focus window right");
+	int id = cfg.hotkeys.hotkeys().back().id;
+
+	Window* target = Window::focused() ? Window::focused()->get_adjacent(Direction::Right) : nullptr;
+	if (!target) {
+		return;
+	}
+
+	// Its warning would otherwise end up in the middle of the JSON.
+	auto prev_severity = min_severity;
+	min_severity = Severity::Error;
+
+	HWND hung = target->handle();
+	auto timeout = chrono::milliseconds{50};
+	set_window_call_timeout(timeout);
+	sim->set_window_hung(hung, true);
+
+	auto window_events = platform().create_window_event_source();
+	EventLoop loop;
+	auto hotkey = [&]() {
+		sim->post_hotkey(id);
+		tick(loop, window_events.get());
+	};
+
+	measure(name, n_windows, hotkey);
+
+	// The stuck call must return before the simulation goes away.
+	sim->set_window_hung(hung, false);
+	while (!is_window_responsive(hung)) {
+		this_thread::sleep_for(chrono::milliseconds{1});
+	}
+
+	set_window_call_timeout(cfg.window_call_timeout());
+	min_severity = prev_severity;
+}
+
+void bench_spatial_index(size_t n_windows) {
+	auto handles = reset(n_windows);
+
+	SpatialIndex index;
+	unordered_map<HWND, clock::time_point> recency_map;
+
+	// Few distinct times, such that ties between equally close windows are common.
+	mt19937 rng{(uint32_t)n_windows};
+	for (HWND h : handles) {
+		index.set(h, sim->window_frame_bounds(h));
+		recency_map[h] = clock::time_point{chrono::seconds{rng() % 4}};
+	}
+
+	auto recency = [&](HWND h) { return recency_map.at(h); };
+
+	size_t i = 0;
+	measure("spatial_index_adjacent", n_windows, [&]() {
+		HWND h = handles[i % handles.size()];
+		index.adjacent(h, DIRECTIONS[i++ % 4], recency);
+	});
+
+	i = 0;
+	measure("spatial_index_brute_force", n_windows, [&]() {
+		HWND h = handles[i % handles.size()];
+		index.adjacent_brute_force(h, DIRECTIONS[i++ % 4], recency);
+	});
+
+	i = 0;
+	measure("spatial_index_set", n_windows, [&]() {
+		HWND h = handles[i++ % handles.size()];
+		index.set(h, sim->window_frame_bounds(h) + Rect{Vec2{(float)(i % 2)}, Vec2{(float)(i % 2)}});
+	});
+}
+
+void bench_bsp(size_t n_windows) {
+	reset(0);
+
+	auto handles = vector<HWND>(n_windows);
+	for (size_t i = 0; i < n_windows; ++i) {
+		handles[i] = (HWND)(i + 1);
+	}
+
+	Rect work_area = {
+		{0.0f,    0.0f   },
+		{1920.0f, 1032.0f}
+	};
+
+	measure("bsp_build", n_windows, [&]() {
+		BspTree tree{work_area};
+		for (size_t i = 0; i < handles.size(); ++i) {
+			tree.insert(handles[i], handles[i / 2]);
+		}
+	});
+
+	BspTree tree{work_area};
+	for (size_t i = 0; i < handles.size(); ++i) {
+		tree.insert(handles[i], handles[i / 2]);
+	}
+
+	HWND extra = (HWND)(n_windows + 1);
+	size_t i = 0;
+	measure("bsp_insert_remove", n_windows, [&]() {
+		tree.insert(extra, handles[i++ % handles.size()]);
+		tree.remove(extra);
+	});
+}
+
+void bench_config() {
+	reset(0);
+
+	measure("config_load_default", 0, []() {
+		Config c;
+		c.load_default();
+	});
+
+	// Includes unregistering the hotkey again when `hotkeys` goes out of scope.
+	measure("hotkeys_add", 0, []() {
+		Hotkeys hotkeys;
+		hotkeys.add("ctrl-alt-shift-l", "swap window right");
+	});
+
+	measure("parse_keycombo", 0, []() { parse_keycombo("ctrl-alt-shift-f13"); });
+	measure("parse_command", 0, []() { parse_command("move_to_desktop window left"); });
+	measure("split", 0, []() { split("ctrl-alt-shift-l", "-"); });
+	measure("to_lower", 0, []() { to_lower("Focus Window Left"); });
+}
+
+// Reloading a config with 500 hotkeys, of which a few changed since the last time: some are gone, some are new, and
+// some trigger a different action. Once only changing what changed and once starting over, as reloads used to.
+void bench_hotkey_reload() {
+	const size_t N_BINDINGS = 500;
+
+	reset(0);
+	auto all = make_hotkey_bindings(N_BINDINGS + 5);
+
+	vector<Binding> a{all.begin(), all.begin() + N_BINDINGS};
+	vector<Binding> b{all.begin() + 5, all.end()};
+	for (size_t i = 0; i < b.size(); i += 50) {
+		b[i].action = "focus window up";
+	}
+
+	Hotkeys hotkeys;
+	hotkeys.set(a);
+
+	size_t i = 0;
+	measure("hotkeys_reload_500_diff", 0, [&]() { hotkeys.set(i++ % 2 == 0 ? b : a); });
+
+	measure("hotkeys_reload_500_full", 0, [&]() {
+		hotkeys.clear();
+		hotkeys.set(i++ % 2 == 0 ? b : a);
+	});
+}
+
+// Resolving the key presses of `n_bindings` key sequences of three keys each, such as "alt-a b c", as the keyboard
+// hook does for every key press and release in the system. Should not depend on the number of bindings.
+void bench_key_sequences(size_t n_bindings) {
+	const string name = format("key_sequence_match_{}", n_bindings);
+	if (!enabled(name)) {
+		return;
+	}
+
+	reset(0);
+
+	auto [bindings, presses] = make_key_sequences(n_bindings);
+
+	vector<KeyInput> stream;
+	for (const auto& keys : presses) {
+		stream.insert(stream.end(), keys.begin(), keys.end());
+	}
+
+	auto matcher = make_shared<KeyMatcher>(bindings, map<string, vector<Binding>>{});
+	InputEngine engine;
+	engine.set_matcher(matcher);
+
+	// What one key costs, without the simulated hook around it. Draining now and then keeps the queue from filling up.
+	size_t i = 0;
+	measure(name, 0, [&]() {
+		engine.on_key(stream[i++ % stream.size()]);
+		if (i % 64 == 0) {
+			engine.drain([](const Command&, clock::time_point) {});
+		}
+	});
+}
+
+// An editor's save may write the config file several times in a row, all of which result in a single reload.
+// Measures the time from the last write to the reload, most of which is the debounce delay.
+void bench_config_reload() {
+	const string name = "config_reload_burst";
+	if (!enabled(name)) {
+		return;
+	}
+
+	reset(0);
+	auto prev_severity = min_severity;
+	min_severity = Severity::Error;
+
+	auto dir = filesystem::temp_directory_path() / "twm_bench";
+	filesystem::create_directories(dir);
+	auto path = dir / "twm.toml";
+
+	auto write = [&](string_view content) {
+		ofstream{path} << content;
+		sim->notify_directory_changed(dir);
+	};
+
+	write("update_interval_seconds = 0.1\n");
+
+	EventLoop loop;
+	ConfigWatcher watcher{loop, path};
+
+	// Runs the loop until the time has come. Never blocks for longer, because the loop always has a task due by then.
+	auto run_until = [&](clock::time_point time, auto done) {
+		loop.schedule(time, []() {});
+		while (!done() && clock::now() < time) {
+			tick(loop, nullptr);
+		}
+	};
+
+	// Each write is noticed before the next one. The directory change signals it, so `tick` does not block.
+	auto burst = [&]() {
+		for (size_t i = 0; i < 50; ++i) {
+			write(format("update_interval_seconds = 0.1\n# Write {}\n", i));
+			tick(loop, nullptr);
+		}
+	};
+
+	measure(name, 0, [&]() {
+		size_t n_reloads = watcher.n_reloads();
+		burst();
+		run_until(clock::now() + chrono::seconds{1}, [&]() { return watcher.n_reloads() > n_reloads; });
+	});
+
+	filesystem::remove_all(dir);
+	min_severity = prev_severity;
+}
+
+// Discards everything written to it.
+class NullBuffer : public streambuf {
+protected:
+	int overflow(int c) override { return c; }
+	streamsize xsputn(const char*, streamsize n) override { return n; }
+};
+
+void bench_logging() {
+	reset(0);
+
+	// The log's output would otherwise end up in the middle of the JSON.
+	NullBuffer null_buffer;
+	auto* prev_buffer = cout.rdbuf(&null_buffer);
+
+	// What the caller pays per message. Flushing now and then keeps the queue from filling up, in which case
+	// messages would be dropped rather than written, and amortizes the cost of writing into the mean.
+	size_t i = 0;
+	measure("log_info", 0, [&]() {
+		log_info("Hotkey handled in {:.2f} ms, of which {:.2f} ms refreshing windows.", 1.23, 0.45);
+		if (++i % 256 == 0) {
+			flush_log();
+		}
+	});
+
+	// The same message, formatted by the caller rather than the writer.
+	measure("log_info_preformatted", 0, [&]() {
+		log_info(format("Hotkey handled in {:.2f} ms, of which {:.2f} ms refreshing windows.", 1.23, 0.45));
+		if (++i % 256 == 0) {
+			flush_log();
+		}
+	});
+
+	// Below the minimum severity. Should cost next to nothing.
+	measure("log_debug_filtered", 0, []() {
+		log_debug("Hotkey handled in {:.2f} ms, of which {:.2f} ms refreshing windows.", 1.23, 0.45);
+	});
+
+	flush_log();
+	cout.rdbuf(prev_buffer);
+}
+
+string to_json(const Result& r) {
+	vector<string> calls;
+	for (size_t i = 0; i < (size_t)SimulatedCall::Count; ++i) {
+		calls.emplace_back(format("\"{}\": {:.3f}", CALL_NAMES[i], r.calls_per_iteration[i]));
+	}
+
+	string json = format(
+		"{{\"name\": \"{}\", \"windows\": {}, \"desktops\": {}, \"iterations\": {}, \"min_ns\": {:.0f}, \"median_ns\": {:.0f}, \"mean_ns\": {:.0f}, \"p95_ns\": {:.0f}, \"platform_calls_per_iteration\": {{{}}}",
+		r.name,
+		r.n_windows,
+		r.n_desktops,
+		r.iterations,
+		r.min_ns,
+		r.median_ns,
+		r.mean_ns,
+		r.p95_ns,
+		join(calls, ", ")
+	);
+
+	return json + "}";
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+	for (int i = 1; i < argc; ++i) {
+		string arg = argv[i];
+		if (arg == "--filter" && i + 1 < argc) {
+			opts.filter = argv[++i];
+		} else if (arg == "--max-windows" && i + 1 < argc) {
+			opts.max_windows = stoull(argv[++i]);
+		} else if (arg == "--latency") {
+			opts.latency = true;
+		} else if (arg == "--out" && i + 1 < argc) {
+			opts.out = argv[++i];
+		} else if (arg == "--trace" && i + 1 < argc) {
+			opts.trace = argv[++i];
+		} else {
+			cerr << "Usage: twm_bench [--filter <substring>] [--max-windows <n>] [--latency] [--out <path>] [--trace <path>]\n";
+			return 1;
+		}
+	}
+
+	try {
+		bench_config();
+		bench_hotkey_reload();
+		bench_config_reload();
+		for (size_t n_bindings : {100, 1000, 10000}) {
+			bench_key_sequences(n_bindings);
+		}
+
+		bench_logging();
+		for (size_t n_windows : WINDOW_COUNTS) {
+			if (n_windows > opts.max_windows) {
+				break;
+			}
+
+			bench_desktop(n_windows);
+			bench_desktops(n_windows);
+			bench_hotkeys(n_windows);
+			bench_desktop_switch(n_windows);
+			bench_hung_window(n_windows);
+			bench_spatial_index(n_windows);
+			bench_bsp(n_windows);
+		}
+	} catch (const runtime_error& e) {
+		cerr << format("Benchmark failed: {}\n", e.what());
+		return 1;
+	}
+
+	vector<string> entries;
+	for (const auto& r : results) {
+		entries.emplace_back("    " + to_json(r));
+	}
+
+	string json = format(
+		"{{\n  \"platform\": \"simulated\",\n  \"latency\": {},\n  \"results\": [\n{}\n  ]\n}}\n",
+		opts.latency,
+		join(entries, ",\n")
+	);
+
+	if (opts.out.empty()) {
+		cout << json;
+	} else {
+		ofstream{opts.out} << json;
+	}
+
+	if (!opts.trace.empty()) {
+		try {
+			save_trace(opts.trace);
+		} catch (const runtime_error& e) {
+			cerr << format("{}\n", e.what());
+			return 1;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,208 @@
+// This file was developed by Thomas Müller <thomas94@gmx.net>.
+// It is published under the GPU GPLv3 license; see LICENSE.txt for details.
+
+#include <twm/bsp.h>
+#include <twm/common.h>
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+namespace twm {
+
+pair<Rect, Rect> split_rect(const Rect& rect, size_t axis, float ratio) {
+	// Snap to whole pixels, which is all windows can be positioned at anyway.
+	float at = round(rect.top_left[axis] + rect.size()[axis] * ratio);
+
+	Rect first = rect, second = rect;
+	if (axis == 0) {
+		first.bottom_right.x = second.top_left.x = at;
+	} else {
+		first.bottom_right.y = second.top_left.y = at;
+	}
+
+	return {first, second};
+}
+
+BspTree::Changes BspTree::insert(HWND handle, HWND split_target) {
+	Changes changes;
+	if (contains(handle)) {
+		return changes;
+	}
+
+	if (!m_root) {
+		m_root = make_unique<BspNode>();
+		m_root->payload = handle;
+		m_leaves[handle] = m_root.get();
+		layout(*m_root, m_work_area, changes);
+		return changes;
+	}
+
+	BspNode* target = nullptr;
+	if (auto it = m_leaves.find(split_target); it != m_leaves.end()) {
+		target = it->second;
+	} else {
+		target = m_root.get();
+		while (auto* children = get_if<BspNode::Children>(&target->payload)) {
+			target = children->right.get();
+		}
+	}
+
+	HWND target_handle = get<HWND>(target->payload);
+
+	auto left = make_unique<BspNode>();
+	left->payload = target_handle;
+	left->parent = target;
+	m_leaves[target_handle] = left.get();
+
+	auto right = make_unique<BspNode>();
+	right->payload = handle;
+	right->parent = target;
+	m_leaves[handle] = right.get();
+
+	// Turn the target leaf into an inner node in place. Nothing outside of it needs to change.
+	target->axis = (size_t)target->rect.size().max_axis();
+	target->ratio = 0.5f;
+	target->payload = BspNode::Children{std::move(left), std::move(right)};
+	layout(*target, target->rect, changes, true);
+
+	return changes;
+}
+
+BspTree::Changes BspTree::remove(HWND handle) {
+	Changes changes;
+
+	auto it = m_leaves.find(handle);
+	if (it == m_leaves.end()) {
+		return changes;
+	}
+
+	BspNode* leaf = it->second;
+	m_leaves.erase(it);
+
+	BspNode* parent = leaf->parent;
+	if (!parent) {
+		m_root.reset();
+		return changes;
+	}
+
+	// The sibling takes the place of the parent. Destroys the parent along with the removed leaf.
+	auto& children = get<BspNode::Children>(parent->payload);
+	auto sibling = std::move(children.left.get() == leaf ? children.right : children.left);
+	sibling->parent = parent->parent;
+
+	Rect rect = parent->rect;
+	auto& slot = owner_of(*parent);
+	slot = std::move(sibling);
+
+	layout(*slot, rect, changes);
+	return changes;
+}
+
+BspTree::Changes BspTree::swap(HWND a, HWND b) {
+	auto it_a = m_leaves.find(a);
+	auto it_b = m_leaves.find(b);
+	if (a == b || it_a == m_leaves.end() || it_b == m_leaves.end()) {
+		return {};
+	}
+
+	BspNode* leaf_a = it_a->second;
+	BspNode* leaf_b = it_b->second;
+
+	leaf_a->payload = b;
+	leaf_b->payload = a;
+	it_a->second = leaf_b;
+	it_b->second = leaf_a;
+
+	return {
+		{a, leaf_b->rect},
+		{b, leaf_a->rect},
+	};
+}
+
+BspTree::Changes BspTree::set_ratio(HWND handle, float ratio) {
+	Changes changes;
+
+	auto it = m_leaves.find(handle);
+	if (it == m_leaves.end() || !it->second->parent) {
+		return changes;
+	}
+
+	BspNode* leaf = it->second;
+	BspNode* parent = leaf->parent;
+
+	ratio = clamp(ratio, 0.05f, 0.95f);
+	parent->ratio = get<BspNode::Children>(parent->payload).left.get() == leaf ? ratio : 1.0f - ratio;
+	layout(*parent, parent->rect, changes, true);
+
+	return changes;
+}
+
+BspTree::Changes BspTree::set_work_area(const Rect& work_area) {
+	Changes changes;
+
+	m_work_area = work_area;
+	if (m_root) {
+		layout(*m_root, m_work_area, changes);
+	}
+
+	return changes;
+}
+
+optional<Rect> BspTree::rect_of(HWND handle) const {
+	auto it = m_leaves.find(handle);
+	if (it == m_leaves.end() || it->second->dirty) {
+		return {};
+	}
+
+	return it->second->rect;
+}
+
+void BspTree::clear() {
+	m_root.reset();
+	m_leaves.clear();
+}
+
+void BspTree::layout(BspNode& root, const Rect& rect, Changes& changes, bool force) {
+	// Iterative rather than recursive, because trees can get deep. E.g.
+	// when tiles are always split at the end, depth grows linearly.
+	vector<pair<BspNode*, Rect>> stack = {
+		{&root, rect}
+	};
+
+	while (!stack.empty()) {
+		auto [node, r] = stack.back();
+		stack.pop_back();
+
+		// Subtrees whose rect did not change are laid out already. The
+		// root of the layout may be forced, e.g. after its ratio changed.
+		if (node->rect == r && !node->dirty && !(force && node == &root)) {
+			continue;
+		}
+
+		node->rect = r;
+		node->dirty = false;
+
+		if (auto* handle = get_if<HWND>(&node->payload)) {
+			changes.emplace_back(*handle, r);
+			continue;
+		}
+
+		auto& children = get<BspNode::Children>(node->payload);
+		auto [first, second] = split_rect(r, node->axis, node->ratio);
+		stack.emplace_back(children.right.get(), second);
+		stack.emplace_back(children.left.get(), first);
+	}
+}
+
+unique_ptr<BspNode>& BspTree::owner_of(BspNode& node) {
+	if (!node.parent) {
+		return m_root;
+	}
+
+	auto& children = get<BspNode::Children>(node.parent->payload);
+	return children.left.get() == &node ? children.left : children.right;
+}
+
+} // namespace twm
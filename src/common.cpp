@@ -11,6 +11,7 @@ using namespace std;
 namespace twm {
 
 // Convenience string processing functions
+#ifdef _WIN32
 string utf16_to_utf8(const wstring& utf16) {
 	string utf8;
 	if (!utf16.empty()) {
@@ -30,6 +31,7 @@ wstring utf8_to_utf16(const string& utf8) {
 	}
 	return utf16;
 }
+#endif
 
 string to_lower(string_view str) {
 	std::string result{str};
@@ -86,6 +88,8 @@ Direction opposite(Direction dir) {
 	}
 }
 
+size_t axis_of(Direction dir) { return dir == Direction::Left || dir == Direction::Right ? 0 : 1; }
+
 std::string to_string(Direction dir) {
 	switch (dir) {
 		case Direction::Up: return "up";
@@ -2,21 +2,50 @@
 // It is published under the GPU GPLv3 license; see LICENSE.txt for details.
 
 #include <twm/config.h>
+#include <twm/input.h>
+#include <twm/logging.h>
 
 #include <toml++/toml.hpp>
 
+#include <format>
 #include <fstream>
+#include <memory>
 
 using namespace std;
 
 namespace twm {
 
-void load_cfg(Config& cfg, const toml::table& file) {
-	cfg.tick_interval_seconds = file["tick_interval_seconds"].value_or(cfg.tick_interval_seconds);
-	cfg.update_interval_seconds = file["update_interval_seconds"].value_or(cfg.update_interval_seconds);
-	cfg.disable_drop_shadows = file["disable_drop_shadows"].value_or(cfg.disable_drop_shadows);
-	cfg.disable_rounded_corners = file["disable_rounded_corners"].value_or(cfg.disable_rounded_corners);
-	cfg.draw_focus_border = file["draw_focus_border"].value_or(cfg.draw_focus_border);
+Config cfg = {};
+
+vector<Binding> read_bindings(const toml::table& table) {
+	vector<Binding> bindings;
+	for (auto binding : table) {
+		if (auto action = binding.second.as_string()) {
+			bindings.emplace_back(string{binding.first.str()}, **action);
+		}
+	}
+
+	return bindings;
+}
+
+struct ParsedConfig {
+	ConfigValues values;
+	vector<Hotkey> hotkeys;
+};
+
+// Builds and validates the whole config, starting from the defaults, without touching the current one.
+ParsedConfig parse_cfg(const toml::table& file) {
+	ParsedConfig parsed;
+	auto& values = parsed.values;
+
+	values.update_interval_seconds = file["update_interval_seconds"].value_or(values.update_interval_seconds);
+	values.reconcile_interval_seconds = file["reconcile_interval_seconds"].value_or(values.reconcile_interval_seconds);
+	values.window_call_timeout_seconds =
+		file["window_call_timeout_seconds"].value_or(values.window_call_timeout_seconds);
+	values.disable_drop_shadows = file["disable_drop_shadows"].value_or(values.disable_drop_shadows);
+	values.disable_rounded_corners = file["disable_rounded_corners"].value_or(values.disable_rounded_corners);
+	values.draw_focus_border = file["draw_focus_border"].value_or(values.draw_focus_border);
+	values.enable_tiling = file["enable_tiling"].value_or(values.enable_tiling);
 
 	auto read_color = [](const auto& v) -> optional<uint32_t> {
 		if (auto osv = v.template value<string_view>()) {
@@ -51,17 +80,30 @@ void load_cfg(Config& cfg, const toml::table& file) {
 		return nullopt;
 	};
 
-	cfg.focused_border_color = read_color(file["focused_border_color"]).value_or(cfg.focused_border_color);
-	cfg.unfocused_border_color = read_color(file["unfocused_border_color"]).value_or(cfg.unfocused_border_color);
+	values.focused_border_color = read_color(file["focused_border_color"]).value_or(values.focused_border_color);
+	values.unfocused_border_color = read_color(file["unfocused_border_color"]).value_or(values.unfocused_border_color);
+
+	if (auto table = file["sequences"].as_table()) {
+		values.sequences = read_bindings(*table);
+	}
 
-	if (auto hotkeys = file["hotkeys"]) {
-		cfg.hotkeys.clear();
-		for (auto hotkey : *hotkeys.as_table()) {
-			if (auto action = hotkey.second.as_string()) {
-				cfg.hotkeys.add(hotkey.first.str(), **action);
+	if (auto table = file["modes"].as_table()) {
+		for (auto mode : *table) {
+			if (auto bindings = mode.second.as_table()) {
+				values.modes[string{mode.first.str()}] = read_bindings(*bindings);
 			}
 		}
 	}
+
+	if (!values.sequences.empty() || !values.modes.empty()) {
+		values.key_matcher = make_shared<const KeyMatcher>(values.sequences, values.modes);
+	}
+
+	if (auto table = file["hotkeys"].as_table()) {
+		parsed.hotkeys = Hotkeys::parse(read_bindings(*table));
+	}
+
+	return parsed;
 }
 
 void Config::load_default() {
@@ -97,22 +139,41 @@ void Config::load_default() {
 	)");
 }
 
-void Config::load_from_file(const filesystem::path& path) {
+shared_ptr<const ParsedConfig> parse_config_file(const filesystem::path& path) {
+	// An editor may be in the middle of replacing the file. Parsing the missing file would yield an empty config.
 	ifstream f{path};
-	load_cfg(*this, toml::parse(f, path.string()));
+	if (!f) {
+		throw runtime_error{format("Failed to open {}", path.string())};
+	}
+
+	return make_shared<ParsedConfig>(parse_cfg(toml::parse(f, path.string())));
 }
 
-void Config::load_from_string(string_view content) {
-	load_cfg(*this, toml::parse(content));
+void Config::load_from_file(const filesystem::path& path) { load(*parse_config_file(path)); }
+void Config::load_from_string(string_view content) { load(parse_cfg(toml::parse(content))); }
+
+void Config::load(const ParsedConfig& parsed) {
+	// Copying may throw, so it happens before anything changes. Moving into place doesn't.
+	ConfigValues values = parsed.values;
+	vector<Hotkey> new_hotkeys = parsed.hotkeys;
+	static_cast<ConfigValues&>(*this) = std::move(values);
+
+	// Doesn't throw either, because the hotkeys were validated by Hotkeys::parse. Keys that are taken must not
+	// fail the load, because the rest of the config is loaded regardless.
+	for (const auto& error : hotkeys.set(std::move(new_hotkeys))) {
+		log_warning("{}", error);
+	}
 }
 
 void Config::save(ostream& out) const {
 	auto file = toml::table{
-		{"tick_interval_seconds", tick_interval_seconds},
 		{"update_interval_seconds", update_interval_seconds},
+		{"reconcile_interval_seconds", reconcile_interval_seconds},
+		{"window_call_timeout_seconds", window_call_timeout_seconds},
 		{"disable_drop_shadows", disable_drop_shadows},
 		{"disable_rounded_corners", disable_rounded_corners},
 		{"draw_focus_border", draw_focus_border},
+		{"enable_tiling", enable_tiling},
 		{"focused_border_color", focused_border_color},
 		{"unfocused_border_color", unfocused_border_color},
 	};
@@ -124,6 +185,29 @@ void Config::save(ostream& out) const {
 
 	file.insert("hotkeys", hotkeys_table);
 
+	if (!sequences.empty()) {
+		toml::table sequences_table;
+		for (const auto& binding : sequences) {
+			sequences_table.insert(binding.keycombo, binding.action);
+		}
+
+		file.insert("sequences", sequences_table);
+	}
+
+	if (!modes.empty()) {
+		toml::table modes_table;
+		for (const auto& [name, bindings] : modes) {
+			toml::table mode_table;
+			for (const auto& binding : bindings) {
+				mode_table.insert(binding.keycombo, binding.action);
+			}
+
+			modes_table.insert(name, mode_table);
+		}
+
+		file.insert("modes", modes_table);
+	}
+
 	out << file;
 }
 
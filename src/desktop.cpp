@@ -0,0 +1,587 @@
+// This file was developed by Thomas Müller <thomas94@gmx.net>.
+// It is published under the GPU GPLv3 license; see LICENSE.txt for details.
+
+#include <twm/common.h>
+#include <twm/config.h>
+#include <twm/desktop.h>
+#include <twm/hotkey.h>
+#include <twm/logging.h>
+#include <twm/platform.h>
+#include <twm/trace.h>
+
+#include <algorithm>
+#include <format>
+
+using namespace std;
+
+namespace twm {
+
+void Window::update() {
+	update_border_color(focused() == this);
+	set_rounded_corners(cfg.disable_rounded_corners ? RoundedCornerPreference::Disabled : RoundedCornerPreference::Default);
+
+	m_rect = get_window_frame_bounds(m_handle);
+	m_marked_for_deletion = false;
+}
+
+bool Window::focus() {
+	Window* prev_focused = focused();
+	if (!focus_window(m_handle)) {
+		return false;
+	}
+
+	if (prev_focused) {
+		prev_focused->update_border_color(false);
+	}
+
+	update_border_color(true);
+
+	m_last_interacted_time = clock::now();
+	return true;
+}
+
+void Window::update_border_color(bool is_focused) {
+	if (cfg.draw_focus_border) {
+		set_border_color(is_focused ? to_colorref(cfg.focused_border_color) : to_colorref(cfg.unfocused_border_color));
+	} else {
+		set_border_color((COLORREF)BorderColor::Default);
+	}
+}
+
+Window* Window::focused() { return Window::get(get_foreground_window()); }
+
+pair<Window*, Window*> Window::focused_and_adjacent(Direction dir) {
+	TraceSpan span{"select_candidate", to_string(dir)};
+
+	// Since only part of the state is refreshed before hotkey actions, the candidate
+	// may be stale. In that case, fall back to a full update and try once more.
+	for (int attempt = 0; attempt < 2; ++attempt) {
+		auto* focused = Window::focused();
+		auto* adj = focused ? focused->get_adjacent(dir) : nullptr;
+		if (!adj) {
+			return {focused, nullptr};
+		}
+
+		if (adj->is_alive()) {
+			// Window events keep the rects current, but the candidate's must be exact to act on it.
+			Desktop::get(adj->handle())->update_rect(*adj, get_window_frame_bounds(adj->handle()));
+			return {focused, adj};
+		}
+
+		// Logs the handle rather than the title, which would be fetched from the window even if the log is off.
+		log_debug("Adjacent window {:#x} is stale. Falling back to a full update.", (uintptr_t)adj->handle());
+		Desktop::update_all();
+	}
+
+	return {nullptr, nullptr};
+}
+
+bool Window::focus_adjacent(Direction dir) {
+	if (auto [_, adj] = focused_and_adjacent(dir); adj) {
+		return adj->focus();
+	}
+
+	return false;
+}
+
+bool Window::focus_adjacent_or_default(Direction dir) {
+	if (focus_adjacent(dir)) {
+		return true;
+	}
+
+	if (auto* d = Desktop::current()) {
+		return d->ensure_focus();
+	}
+
+	return false;
+}
+
+bool Window::swap_adjacent(Direction dir) {
+	if (auto [focused, adj] = focused_and_adjacent(dir); adj) {
+		adj->update_last_interacted_time();
+		focused->update_last_interacted_time();
+
+		// Tiled windows swap their tiles, such that the layout stays consistent.
+		auto* desktop = Desktop::get(focused->handle());
+		if (desktop && desktop->m_tree.contains(focused->handle()) && desktop->m_tree.contains(adj->handle())) {
+			return desktop->apply_layout(desktop->m_tree.swap(focused->handle(), adj->handle()));
+		}
+
+		return set_rects({
+			{focused, adj->rect()    },
+			{adj,     focused->rect()},
+		});
+	}
+
+	return false;
+}
+
+// The following is currently broken. Windows does not give permission
+// to move windows that aren't owned by this process -- tough luck.
+// TODO: map IVirtualDesktopManagerInternal and use it instead while
+// dealing with potential breakage.
+bool Window::move_to_adjacent_desktop(Direction dir) {
+	if (auto* focused = Window::focused()) {
+		HWND handle = focused->handle();
+		Desktop::focus_adjacent(dir);
+		if (auto* desktop = Desktop::current()) {
+			if (desktop->move_window_to_here(handle)) {
+				auto* window = desktop->get_window(handle);
+				TWM_ASSERT(window);
+				return window->focus();
+			}
+		}
+	}
+
+	return false;
+}
+
+bool Window::set_rect(const Rect& r) {
+	if (!set_window_frame_bounds(m_handle, r)) {
+		return false;
+	}
+
+	if (auto* desktop = Desktop::get(m_handle)) {
+		desktop->update_rect(*this, r);
+	} else {
+		m_rect = r;
+	}
+
+	return true;
+}
+
+bool Window::set_rects(const vector<pair<Window*, Rect>>& targets) {
+	GeometryTransaction transaction;
+	for (const auto& [w, r] : targets) {
+		transaction.stage(w->handle(), r);
+	}
+
+	auto failed = transaction.commit();
+	for (const auto& [w, r] : targets) {
+		if (find(failed.begin(), failed.end(), w->handle()) != failed.end()) {
+			log_warning("Could not move window '{}'", w->name());
+			continue;
+		}
+
+		if (auto* desktop = Desktop::get(w->handle())) {
+			desktop->update_rect(*w, r);
+		} else {
+			w->m_rect = r;
+		}
+	}
+
+	return failed.empty();
+}
+
+Window* Window::get(HWND handle) {
+	auto it = Desktop::locations().find(handle);
+	return it != Desktop::locations().end() ? it->second.window : nullptr;
+}
+
+Window* Window::get_adjacent(Direction dir) const {
+	auto* desktop = Desktop::get(m_handle);
+	return desktop ? desktop->get_adjacent_window(m_handle, dir) : nullptr;
+}
+
+bool Desktop::try_manage(HWND handle, bool is_focused) {
+	if (!can_be_managed(handle)) {
+		return false;
+	}
+
+	auto it = m_windows.find(handle);
+	bool inserted = it == m_windows.end();
+	if (inserted) {
+		it = m_windows.insert({handle, Window{handle}}).first;
+	} else {
+		it->second.update();
+	}
+
+	// While `update_all` runs, a window that moved desktops may briefly be held by both. The new one owns it.
+	locations()[handle] = {this, &it->second};
+
+	m_index.set(handle, it->second.rect());
+
+	if (inserted && cfg.enable_tiling) {
+		tile(handle);
+	}
+
+	if (is_focused) {
+		it->second.update_last_interacted_time();
+		m_last_focus = handle;
+	}
+
+	return true;
+}
+
+void Desktop::unmanage(HWND handle) {
+	if (auto it = m_windows.find(handle); it != m_windows.end()) {
+		erase_window(it);
+		invalidate_window_caches(handle);
+	}
+
+	m_index.erase(handle);
+	apply_layout(m_tree.remove(handle));
+}
+
+unordered_map<HWND, Window>::iterator Desktop::erase_window(unordered_map<HWND, Window>::iterator it) {
+	if (auto loc = locations().find(it->first); loc != locations().end() && loc->second.desktop == this) {
+		locations().erase(loc);
+	}
+
+	return m_windows.erase(it);
+}
+
+Desktop::~Desktop() {
+	for (auto it = m_windows.begin(); it != m_windows.end();) {
+		it = erase_window(it);
+	}
+}
+
+void Desktop::tile(HWND handle) {
+	if (m_tree.empty()) {
+		m_tree.set_work_area(get_primary_work_area());
+	}
+
+	apply_layout(m_tree.insert(handle, m_last_focus));
+}
+
+bool Desktop::apply_layout(const BspTree::Changes& changes) {
+	vector<pair<Window*, Rect>> targets;
+	for (const auto& [handle, r] : changes) {
+		if (auto* w = get_window(handle)) {
+			targets.emplace_back(w, r);
+		}
+	}
+
+	return targets.empty() || Window::set_rects(targets);
+}
+
+void Desktop::update_rect(Window& w, const Rect& r) {
+	w.m_rect = r;
+	m_index.set(w.handle(), r);
+}
+
+void Desktop::pre_update() {
+	for (auto& [_, w] : m_windows) {
+		w.mark_for_deletion();
+	}
+}
+
+void Desktop::post_update() {
+	vector<HWND> removed;
+	for (const auto& [handle, w] : m_windows) {
+		if (w.marked_for_deletion()) {
+			removed.emplace_back(handle);
+		}
+	}
+
+	// Remove all windows before re-tiling, such that none of the removed windows is moved in the process.
+	for (HWND handle : removed) {
+		erase_window(m_windows.find(handle));
+		m_index.erase(handle);
+
+		// A window that merely moved to another desktop is still the same window, and its caches are still valid.
+		if (locations().count(handle) == 0) {
+			invalidate_window_caches(handle);
+		}
+	}
+
+	BspTree::Changes changes;
+	for (HWND handle : removed) {
+		auto tmp = m_tree.remove(handle);
+		changes.insert(changes.end(), tmp.begin(), tmp.end());
+	}
+
+	apply_layout(changes);
+
+	if (m_windows.count(m_last_focus) == 0) {
+		m_last_focus = nullptr;
+	}
+}
+
+void Desktop::update_all() {
+	TraceSpan span{"update_all"};
+
+	bool infer_current = !tracks_current_id() || !current_id().has_value();
+	if (infer_current) {
+		current_id() = {};
+	}
+
+	for (auto& [_, d] : all()) {
+		d.pre_update();
+	}
+
+	HWND current_focus = get_foreground_window();
+	for (HWND handle : enumerate_windows()) {
+		optional<GUID> opt_desktop_id = get_window_desktop_id(handle);
+		if (!opt_desktop_id.has_value()) {
+			// Window does not seem to belong to any desktop... can't be managed by this app.
+			continue;
+		}
+
+		GUID desktop_id = opt_desktop_id.value();
+
+		// If the window's desktop already exists, query it. Otherwise, create
+		// a new desktop object, keep track of it in `desktops`, and use that one.
+		auto& desktop = all().try_emplace(desktop_id, desktop_id).first->second;
+		if (!desktop.try_manage(handle, handle == current_focus)) {
+			// If the desktop can't manage the window, don't consider it as candidate for current desktop.
+			continue;
+		}
+
+		// The Windows API does not give us a direct way to query the currently active desktop, but it
+		// allows us to check whether a given Window is on the current desktop. So if we find such a
+		// window, we can deduce that its desktop's GUID is the currently active desktop.
+		if (infer_current && !current_id().has_value() && is_window_on_current_desktop(handle)) {
+			current_id() = desktop_id;
+		}
+	}
+
+	for (auto& [_, d] : all()) {
+		d.post_update();
+	}
+
+	// The current desktop is kept even if empty, such that windows that are moved or opened there find it.
+	erase_if(all(), [](const auto& item) {
+		return item.second.empty() && !(current_id().has_value() && equal_to<GUID>{}(item.first, current_id().value()));
+	});
+}
+
+void Desktop::set_current_id(const optional<GUID>& id) {
+	current_id() = id;
+	if (id.has_value()) {
+		all().try_emplace(id.value(), id.value());
+	}
+}
+
+void Desktop::refresh(HWND handle, bool is_focused) {
+	optional<GUID> opt_desktop_id = get_window_desktop_id(handle);
+	if (!opt_desktop_id.has_value()) {
+		forget(handle);
+		return;
+	}
+
+	GUID desktop_id = opt_desktop_id.value();
+
+	// The window may have been moved from another desktop.
+	if (auto* prev = get(handle); prev && !equal_to<GUID>{}(prev->id(), desktop_id)) {
+		prev->unmanage(handle);
+	}
+
+	auto& desktop = all().try_emplace(desktop_id, desktop_id).first->second;
+	if (!desktop.try_manage(handle, is_focused)) {
+		desktop.unmanage(handle);
+	}
+}
+
+void Desktop::forget(HWND handle) {
+	if (auto* desktop = get(handle)) {
+		desktop->unmanage(handle);
+	}
+}
+
+void Desktop::apply(const WindowEvent& event) {
+	static HWND last_foreground = nullptr;
+
+	switch (event.type) {
+		case WindowEventType::Created:
+		case WindowEventType::Destroyed:
+		case WindowEventType::Shown:
+		case WindowEventType::Cloaked:
+		case WindowEventType::Uncloaked: invalidate_window_desktop_id(event.handle); break;
+		default: break;
+	}
+
+	switch (event.type) {
+		case WindowEventType::Destroyed: forget(event.handle); break;
+		case WindowEventType::NameChanged: {
+			// Titles are fetched on first use, so only the stale one needs dropping.
+			if (auto* w = Window::get(event.handle)) {
+				w->m_name = {};
+			}
+
+			refresh(event.handle);
+		} break;
+		case WindowEventType::LocationChanged: {
+			// Moves and resizes don't affect manageability, so only the rect needs refreshing.
+			if (auto* desktop = Desktop::get(event.handle)) {
+				desktop->update_rect(*desktop->get_window(event.handle), get_window_frame_bounds(event.handle));
+			}
+		} break;
+		case WindowEventType::Foreground: {
+			if (auto* prev = Window::get(last_foreground)) {
+				prev->update_border_color(false);
+			}
+
+			last_foreground = event.handle;
+			refresh(event.handle, true);
+
+			// The window the user just activated is necessarily on the current desktop.
+			if (auto* desktop = Desktop::get(event.handle)) {
+				current_id() = desktop->id();
+			}
+		} break;
+		default: refresh(event.handle); break;
+	}
+}
+
+void Desktop::refresh_for_action() {
+	TraceSpan span{"refresh_for_action"};
+
+	if (HWND foreground = get_foreground_window()) {
+		refresh(foreground, true);
+		if (auto* desktop = Desktop::get(foreground)) {
+			current_id() = desktop->id();
+		}
+	}
+}
+
+void Desktop::update_tiling() {
+	for (auto& [_, d] : all()) {
+		if (!cfg.enable_tiling) {
+			// Windows simply stay where they are.
+			d.m_tree.clear();
+			continue;
+		}
+
+		for (const auto& [handle, _] : d.m_windows) {
+			if (!d.m_tree.contains(handle)) {
+				d.tile(handle);
+			}
+		}
+	}
+}
+
+Desktop* Desktop::get(GUID id) {
+	auto it = all().find(id);
+	return it != all().end() ? &it->second : nullptr;
+}
+
+void Desktop::focus_adjacent(Direction dir) {
+	if (dir != Direction::Left && dir != Direction::Right) {
+		throw runtime_error{"Desktops can only be focused left or right"};
+	}
+
+	auto start = clock::now();
+	if (auto desktops = get_virtual_desktops()) {
+		// Like the shell's shortcuts, don't wrap around.
+		size_t index = desktops->current;
+		if (dir == Direction::Left && index > 0) {
+			show(desktops->ids[index - 1], start);
+		} else if (dir == Direction::Right && index + 1 < desktops->ids.size()) {
+			show(desktops->ids[index + 1], start);
+		}
+
+		return;
+	}
+
+	// HACK HACK HACK: without the desktop manager, send the default hotkey combination
+	// for switching desktops to the system. This has the potential for all sorts of
+	// breakage like keyboard race conditions, conflicts with user-held keys, or changes
+	// in the shortcut.
+	Hotkeys::send_to_system(format("ctrl-win-{}", dir == Direction::Left ? "left" : "right"));
+
+	// After switching desktops, re-run a full update to ensure the current desktop
+	// is correctly registered.
+	Desktop::update_all();
+
+	auto end = clock::now();
+	trace("desktop_switch", start, end, "keystrokes");
+	log_debug(
+		"Switched desktops through keyboard shortcuts in {:.2f} ms",
+		chrono::duration<double, milli>(end - start).count()
+	);
+}
+
+void Desktop::focus_index(size_t index) {
+	auto start = clock::now();
+	auto desktops = get_virtual_desktops();
+	if (!desktops) {
+		log_warning("Can't focus desktop {} without the desktop manager", index + 1);
+		return;
+	}
+
+	if (index >= desktops->ids.size()) {
+		log_debug("Can't focus desktop {}: there are only {}", index + 1, desktops->ids.size());
+		return;
+	}
+
+	show(desktops->ids[index], start);
+}
+
+void Desktop::show(const GUID& id, clock::time_point start) {
+	if (!switch_to_desktop(id)) {
+		return;
+	}
+
+	// The switch is done once the call returns, so, unlike after keystrokes, there is no need to look for the new
+	// current desktop. Should the shell not have focused one of its windows, focus the one that was focused last.
+	set_current_id(id);
+	if (auto* desktop = current()) {
+		desktop->ensure_focus();
+	}
+
+	auto end = clock::now();
+	trace("desktop_switch", start, end, "direct");
+	log_debug(
+		"Switched desktops through the desktop manager in {:.2f} ms",
+		chrono::duration<double, milli>(end - start).count()
+	);
+}
+
+Window* Desktop::last_focus_or_default() {
+	if (auto it = m_windows.find(m_last_focus); it != m_windows.end()) {
+		return &it->second;
+	}
+
+	if (!m_windows.empty()) {
+		return &m_windows.begin()->second;
+	}
+
+	return nullptr;
+}
+
+bool Desktop::ensure_focus() {
+	if (m_windows.count(get_foreground_window()) > 0) {
+		return false;
+	}
+
+	auto* w = last_focus_or_default();
+	return w && w->focus();
+}
+
+bool Desktop::move_window_to_here(HWND handle) {
+	if (!move_window_to_desktop(handle, m_id)) {
+		return false;
+	}
+
+	if (auto* prev_desktop = Desktop::get(handle)) {
+		prev_desktop->unmanage(handle);
+	}
+
+	return try_manage(handle, false);
+}
+
+Window* Desktop::get_adjacent_window(HWND handle, Direction dir) {
+	auto recency = [this](HWND h) {
+		auto* w = get_window(h);
+		return w ? w->last_focus_time() : clock::time_point{};
+	};
+
+	HWND adjacent = m_index.adjacent(handle, dir, recency);
+
+#ifndef NDEBUG
+	// Cross-check the index against an exhaustive search.
+	TWM_ASSERT(adjacent == m_index.adjacent_brute_force(handle, dir, recency));
+#endif
+
+	return get_window(adjacent);
+}
+
+void Desktop::print() const {
+	for (auto& [_, w] : m_windows) {
+		log_info(w.name());
+	}
+}
+
+} // namespace twm
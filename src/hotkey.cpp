@@ -3,101 +3,80 @@
 
 #include <twm/common.h>
 #include <twm/hotkey.h>
+#include <twm/keys.h>
 #include <twm/logging.h>
 #include <twm/platform.h>
 
 #include <format>
 #include <iostream>
+#include <optional>
 #include <string>
+#include <unordered_map>
 
 using namespace std;
 
 namespace twm {
 
-unordered_map<string, UINT> string_to_modifier = {
-	{"ctrl",    MOD_CONTROL},
-	{"control", MOD_CONTROL},
-	{"alt",     MOD_ALT    },
-	{"super",   MOD_WIN    },
-	{"win",     MOD_WIN    },
-	{"shift",   MOD_SHIFT  },
-};
-
-// Modifiert also have VK keycodes. Those should not be
-// used in RegisterHotKey, but _should_ be used in SendInputs.
-unordered_map<string, UINT> string_to_keycode = {
-	{"up",        VK_UP     },
-	{"down",      VK_DOWN   },
-	{"left",      VK_LEFT   },
-	{"right",     VK_RIGHT  },
-	{"back",      VK_BACK   },
-	{"backspace", VK_BACK   },
-	{"tab",       VK_TAB    },
-	{"return",    VK_RETURN },
-	{"enter",     VK_RETURN },
-	{"escape",    VK_ESCAPE },
-	{"esc",       VK_ESCAPE },
-	{"space",     VK_SPACE  },
-	{"ctrl",      VK_CONTROL},
-	{"control",   VK_CONTROL},
-	{"alt",       VK_MENU   },
-	{"super",     VK_LWIN   },
-	{"win",       VK_LWIN   },
-	{"shift",     VK_SHIFT  },
-};
-
-vector<INPUT> keys_to_inputs(const string& keycombo, SendMode mode) {
-	vector<INPUT> inputs;
-	for (const auto& part : split(keycombo, "-")) {
-		auto name = to_lower(trim(part));
+// Every name leads to its key, every key's canonical name leads back to it, and names are written such that keycombos
+// can reach them.
+constexpr bool key_names_round_trip() {
+	for (const auto& key : KEY_NAMES) {
+		if (find_key(key.name) != key.keycode || find_key(key_name(key.keycode)) != key.keycode) {
+			return false;
+		}
 
-		INPUT in = {};
-		in.type = INPUT_KEYBOARD;
+		if (key.name.empty() || key.name.find_first_of("- \t\n\r\f\v") != string_view::npos) {
+			return false;
+		}
 
-		if (auto it = string_to_keycode.find(name); it != string_to_keycode.end()) {
-			in.ki.wVk = (WORD)it->second;
-		} else {
-			in.ki.wVk = (char)toupper(name[0]);
+		for (char c : key.name) {
+			if (c >= 'A' && c <= 'Z') {
+				return false;
+			}
 		}
+	}
 
-		in.ki.dwFlags = mode == SendMode::Release ? KEYEVENTF_KEYUP : 0;
-		inputs.emplace_back(in);
+	for (UINT keycode = 0; keycode < 256; ++keycode) {
+		if (auto name = key_name(keycode); !name.empty() && find_key(name) != keycode) {
+			return false;
+		}
 	}
 
-	if (mode == SendMode::PressAndRelease) {
-		size_t n_keys = inputs.size();
-		for (size_t i = 0; i < n_keys; ++i) {
-			INPUT in = inputs[n_keys - i - 1];
-			in.ki.dwFlags = KEYEVENTF_KEYUP;
-			inputs.emplace_back(in);
+	for (const auto& modifier : MODIFIER_NAMES) {
+		if (!find_key(modifier.name)) {
+			return false;
 		}
 	}
 
-	return inputs;
+	return !find_key("") && !find_key("f25") && !find_key("F1");
 }
 
-UINT held_mods() {
-	UINT result = 0;
-	if (GetAsyncKeyState(VK_CONTROL) & 0x8000) {
-		result |= MOD_CONTROL;
-	}
+static_assert(key_names_round_trip());
 
-	if (GetAsyncKeyState(VK_MENU) & 0x8000) {
-		result |= MOD_ALT;
-	}
+vector<KeyInput> keys_to_inputs(const string& keycombo, SendMode mode) {
+	vector<KeyInput> inputs;
+	for (const auto& part : split(keycombo, "-")) {
+		auto keycode = find_key(to_lower(trim(part)));
+		if (!keycode) {
+			throw runtime_error{format("Unknown key \"{}\" in {}", trim(part), keycombo)};
+		}
 
-	if (GetAsyncKeyState(VK_SHIFT) & 0x8000) {
-		result |= MOD_SHIFT;
+		inputs.push_back({*keycode, mode == SendMode::Release});
 	}
 
-	if (GetAsyncKeyState(VK_LWIN) & 0x8000) {
-		result |= MOD_WIN;
+	if (mode == SendMode::PressAndRelease) {
+		size_t n_keys = inputs.size();
+		for (size_t i = 0; i < n_keys; ++i) {
+			KeyInput in = inputs[n_keys - i - 1];
+			in.release = true;
+			inputs.emplace_back(in);
+		}
 	}
 
-	return result;
+	return inputs;
 }
 
-vector<INPUT> mods_to_inputs(UINT mods, SendMode mode) {
+vector<KeyInput> mods_to_inputs(UINT mods, SendMode mode) {
 	vector<string> mod_names;
 	if (mods & MOD_ALT) {
 		mod_names.emplace_back("alt");
@@ -115,6 +94,10 @@ vector<INPUT> mods_to_inputs(UINT mods, SendMode mode) {
 		mod_names.emplace_back("shift");
 	}
 
+	if (mod_names.empty()) {
+		return {};
+	}
+
 	return keys_to_inputs(join(mod_names, "-"), mode);
 }
 
@@ -123,74 +106,212 @@ void Hotkeys::send_to_system(const string& keycombo, SendMode mode) {
 	// e.g. to access functionality that is not exposed by the Windows API
 	// such as virtual desktop switching, let us temporarily let go of any
 	// currently held hotkeys to avoid interference.
-	uint32_t mods = held_mods();
+	UINT mods = platform().held_modifiers();
 	auto inputs = mods_to_inputs(mods, SendMode::Release);
 	auto tmp = keys_to_inputs(keycombo, mode);
 	inputs.insert(inputs.end(), tmp.begin(), tmp.end());
 	tmp = mods_to_inputs(mods, SendMode::Press);
 	inputs.insert(inputs.end(), tmp.begin(), tmp.end());
 
-	if (UINT n_sent = SendInput((UINT)inputs.size(), inputs.data(), sizeof(INPUT)); n_sent != inputs.size()) {
-		throw runtime_error{format("SendInput failed: {}", last_error_string())};
-	}
+	platform().send_input(inputs);
 }
 
-void Hotkeys::add(string_view keycombo, string_view action) {
-	int id = (int)m_hotkeys.size();
-	auto parts = split(keycombo, "-");
+// Windows reserves hotkey IDs above 0xBFFF for shared DLLs. That leaves 48 generations per slot.
+const int MAX_HOTKEY_ID = 0xBFFF;
+const int N_HOTKEY_SLOTS = 1024;
+const int N_HOTKEY_GENERATIONS = (MAX_HOTKEY_ID + 1) / N_HOTKEY_SLOTS;
+
+pair<UINT, UINT> parse_keycombo(string_view keycombo) {
 	UINT mod = 0;
 	UINT keycode = 0;
-
-	// keycombo is of the form mod1-mod2-...-keycode
-	// case insensitive and with optional spaces. Parse below.
-	for (const auto& part : parts) {
+	for (const auto& part : split(keycombo, "-")) {
 		auto name = to_lower(trim(part));
-
-		if (auto it = string_to_modifier.find(name); it != string_to_modifier.end()) {
-			mod |= it->second;
+		if (auto modifier = find_modifier(name)) {
+			mod |= *modifier;
 			continue;
 		}
 
-		// If none of the above modifiers is given, that means we are given a keycode.
-		// Only one keycode per keybinding is allowed -- check for this.
+		auto key = find_key(name);
+		if (!key) {
+			throw runtime_error{format("unknown key \"{}\"", trim(part))};
+		}
+
+		// Only one key per keycombo is allowed.
 		if (keycode != 0) {
-			throw runtime_error{format("Error registering {}: duplicate keycode {}", keycombo, keycode)};
+			throw runtime_error{format("more than one key: \"{}\"", trim(part))};
 		}
 
-		if (auto it = string_to_keycode.find(name); it != string_to_keycode.end()) {
-			keycode = it->second;
-			continue;
+		keycode = *key;
+	}
+
+	return {mod, keycode};
+}
+
+// Parses the keycombo and the action, but leaves the ID to be assigned.
+Hotkey parse_hotkey(string_view keycombo, string_view action) {
+	Command command;
+	pair<UINT, UINT> keys;
+	try {
+		command = parse_command(action);
+		keys = parse_keycombo(keycombo);
+	} catch (const runtime_error& e) {
+		throw runtime_error{format("Error registering {}: {}", keycombo, e.what())};
+	}
+
+	return {-1, string{action}, string{keycombo}, command, keys.first, keys.second};
+}
+
+// Differently written keycombos, e.g. "alt-h" and "Alt-H", may denote the same keys.
+uint64_t keys_of(const Hotkey& hotkey) { return (uint64_t)hotkey.modifiers << 32 | hotkey.keycode; }
+
+int Hotkeys::acquire_id() {
+	// Free slots are reused in the order they were freed, such that a removed hotkey's ID comes back as late as
+	// possible.
+	int slot;
+	if (!m_free_slots.empty()) {
+		slot = m_free_slots.front();
+		m_free_slots.pop_front();
+	} else if (m_slots.size() < N_HOTKEY_SLOTS) {
+		slot = (int)m_slots.size();
+		m_slots.emplace_back();
+	} else {
+		throw runtime_error{format("Can't register more than {} hotkeys", N_HOTKEY_SLOTS)};
+	}
+
+	return m_slots[slot].generation * N_HOTKEY_SLOTS + slot;
+}
+
+void Hotkeys::release_id(int id) {
+	int slot = id % N_HOTKEY_SLOTS;
+	m_slots[slot].generation = (m_slots[slot].generation + 1) % N_HOTKEY_GENERATIONS;
+	m_slots[slot].index = -1;
+	m_free_slots.push_back(slot);
+}
+
+void Hotkeys::index_slots() {
+	for (size_t i = 0; i < m_hotkeys.size(); ++i) {
+		m_slots[m_hotkeys[i].id % N_HOTKEY_SLOTS].index = (int)i;
+	}
+}
+
+void Hotkeys::add(string_view keycombo, string_view action) {
+	auto hotkey = parse_hotkey(keycombo, action);
+	hotkey.id = acquire_id();
+
+	try {
+		platform().register_hotkey(hotkey.id, hotkey.modifiers, hotkey.keycode);
+	} catch (const runtime_error& e) {
+		release_id(hotkey.id);
+		throw runtime_error{format("Error registering {}: {}", keycombo, e.what())};
+	}
+
+	m_slots[hotkey.id % N_HOTKEY_SLOTS].index = (int)m_hotkeys.size();
+	m_hotkeys.emplace_back(std::move(hotkey));
+}
+
+vector<Hotkey> Hotkeys::parse(const vector<Binding>& bindings) {
+	if (bindings.size() > N_HOTKEY_SLOTS) {
+		throw runtime_error{format("Can't register more than {} hotkeys", N_HOTKEY_SLOTS)};
+	}
+
+	vector<Hotkey> hotkeys;
+	unordered_map<uint64_t, size_t> index_by_keys;
+	for (const auto& binding : bindings) {
+		auto hotkey = parse_hotkey(binding.keycombo, binding.action);
+		auto [it, inserted] = index_by_keys.try_emplace(keys_of(hotkey), hotkeys.size());
+		if (!inserted) {
+			throw runtime_error{
+				format("Error registering {}: same keys as {}", binding.keycombo, hotkeys[it->second].keycombo)
+			};
 		}
 
-		if (name.size() != 1) {
-			throw runtime_error{format("Error registering {}: unknown keycode {}", keycombo, keycode)};
+		hotkeys.emplace_back(std::move(hotkey));
+	}
+
+	return hotkeys;
+}
+
+vector<string> Hotkeys::set(vector<Hotkey> hotkeys) {
+	// Everything that can throw happens before any hotkey changes.
+	if (hotkeys.size() > N_HOTKEY_SLOTS) {
+		throw runtime_error{format("Can't register more than {} hotkeys", N_HOTKEY_SLOTS)};
+	}
+
+	unordered_map<uint64_t, size_t> index_by_keys;
+	for (size_t i = 0; i < hotkeys.size(); ++i) {
+		if (auto [it, inserted] = index_by_keys.try_emplace(keys_of(hotkeys[i]), i); !inserted) {
+			throw runtime_error{
+				format("Error registering {}: same keys as {}", hotkeys[i].keycombo, hotkeys[it->second].keycombo)
+			};
 		}
+	}
+
+	vector<Hotkey> registered;
+	registered.reserve(hotkeys.size());
 
-		keycode = (char)toupper(name[0]);
+	// Hotkeys that are gone are unregistered first, such that new hotkeys can take over their keys.
+	for (const auto& hotkey : m_hotkeys) {
+		if (auto it = index_by_keys.find(keys_of(hotkey)); it != index_by_keys.end()) {
+			hotkeys[it->second].id = hotkey.id;
+		} else {
+			platform().unregister_hotkey(hotkey.id);
+			release_id(hotkey.id);
+		}
 	}
 
-	if (RegisterHotKey(nullptr, id, mod, keycode) == 0) {
-		throw runtime_error{format("Error registering {}: {}", keycombo, last_error_string())};
+	// There are enough free slots, because there are no more hotkeys than slots.
+	vector<string> errors;
+	for (auto& hotkey : hotkeys) {
+		if (hotkey.id == -1) {
+			int id = acquire_id();
+			try {
+				platform().register_hotkey(id, hotkey.modifiers, hotkey.keycode);
+			} catch (const runtime_error& e) {
+				release_id(id);
+				errors.emplace_back(format("Error registering {}: {}", hotkey.keycombo, e.what()));
+				continue;
+			}
+
+			hotkey.id = id;
+		}
+
+		registered.emplace_back(std::move(hotkey));
 	}
 
-	m_hotkeys.emplace_back(id, string{action}, string{keycombo});
+	m_hotkeys = std::move(registered);
+	index_slots();
+
+	return errors;
 }
 
-string_view Hotkeys::action_of(int id) const {
-	if (id < 0 || id >= (int)m_hotkeys.size()) {
-		throw runtime_error{"Invalid hotkey id"};
+const Hotkey* Hotkeys::find(int id) const {
+	if (id < 0 || id % N_HOTKEY_SLOTS >= (int)m_slots.size()) {
+		return nullptr;
 	}
 
-	const Hotkey& hk = m_hotkeys[id];
-	return hk.action;
+	int index = m_slots[id % N_HOTKEY_SLOTS].index;
+	if (index < 0 || m_hotkeys[index].id != id) {
+		return nullptr;
+	}
+
+	return &m_hotkeys[index];
+}
+
+const Hotkey& Hotkeys::get(int id) const {
+	if (auto hotkey = find(id)) {
+		return *hotkey;
+	}
+
+	throw runtime_error{"Invalid hotkey id"};
 }
 
 void Hotkeys::clear() {
-	for (size_t i = 0; i < m_hotkeys.size(); ++i) {
+	for (const auto& hotkey : m_hotkeys) {
 		// We do not care about errors in the unregistering process here.
 		// Simply try to unbind all hotkeys and hope for the best -- there
 		// is nothing we can do if unbinding fails.
-		UnregisterHotKey(nullptr, (int)i);
+		platform().unregister_hotkey(hotkey.id);
+		release_id(hotkey.id);
 	}
 
 	m_hotkeys.clear();
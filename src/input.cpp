@@ -0,0 +1,299 @@
+// This file was developed by Thomas Müller <thomas94@gmx.net>.
+// It is published under the GPU GPLv3 license; see LICENSE.txt for details.
+
+#include <twm/common.h>
+#include <twm/input.h>
+#include <twm/platform.h>
+
+#include <algorithm>
+#include <bit>
+#include <format>
+#include <unordered_map>
+
+using namespace std;
+
+namespace twm {
+
+KeyMatcher::KeyMatcher(const vector<Binding>& sequences, const map<string, vector<Binding>>& modes) {
+	// Each mode's root comes first, the default mode's being ROOT.
+	unordered_map<string, uint32_t> roots = {
+		{"default", ROOT}
+	};
+	m_roots.emplace_back(ROOT);
+	for (const auto& [name, bindings] : modes) {
+		if (name == "default") {
+			throw runtime_error{"Error binding mode default: the name is reserved for the bindings outside of modes"};
+		}
+
+		uint32_t root = (uint32_t)m_roots.size();
+		roots[name] = root;
+		m_roots.emplace_back(root);
+	}
+
+	// By state and chord. Those that end a sequence also remember its binding, such that conflicts can name it.
+	unordered_map<uint64_t, Target> transitions;
+	unordered_map<uint64_t, const Binding*> ends;
+
+	auto add = [&](uint32_t root, const Binding& binding) {
+		vector<Chord> chords;
+		for (const auto& part : split(binding.keycombo, " ")) {
+			if (part.empty()) {
+				continue;
+			}
+
+			pair<UINT, UINT> keys;
+			try {
+				keys = parse_keycombo(part);
+			} catch (const runtime_error& e) {
+				throw runtime_error{format("Error binding {}: {}", binding.keycombo, e.what())};
+			}
+
+			if (keys.second == 0) {
+				throw runtime_error{format("Error binding {}: {} has no key", binding.keycombo, part)};
+			}
+
+			chords.emplace_back(to_chord(keys.first, keys.second));
+		}
+
+		if (chords.empty()) {
+			throw runtime_error{format("Error binding {}: no keys", binding.keycombo)};
+		}
+
+		Target end = {root};
+		if (auto parts = split(trim(binding.action), " "); to_lower(parts[0]) == "mode") {
+			if (parts.size() != 2 || !roots.contains(parts[1])) {
+				throw runtime_error{format("Error binding {}: unknown mode in {}", binding.keycombo, binding.action)};
+			}
+
+			end.state = roots[parts[1]];
+		} else {
+			try {
+				m_commands.emplace_back(parse_command(binding.action));
+			} catch (const runtime_error& e) {
+				throw runtime_error{format("Error binding {}: {}", binding.keycombo, e.what())};
+			}
+
+			end.command = (int32_t)m_commands.size() - 1;
+		}
+
+		uint32_t state = root;
+		for (size_t i = 0; i < chords.size(); ++i) {
+			uint64_t key = (uint64_t)state << 32 | chords[i];
+			if (auto it = ends.find(key); it != ends.end()) {
+				throw runtime_error{format("Error binding {}: conflicts with {}", binding.keycombo, it->second->keycombo)};
+			}
+
+			bool last = i + 1 == chords.size();
+			if (auto it = transitions.find(key); it != transitions.end()) {
+				if (last) {
+					throw runtime_error{format("Error binding {}: longer sequences start with it", binding.keycombo)};
+				}
+
+				state = it->second.state;
+			} else if (last) {
+				transitions[key] = end;
+				ends[key] = &binding;
+			} else {
+				uint32_t next = (uint32_t)m_roots.size();
+				m_roots.emplace_back(root);
+				transitions[key] = {next};
+				state = next;
+			}
+		}
+	};
+
+	for (const auto& binding : sequences) {
+		add(ROOT, binding);
+	}
+
+	for (const auto& [name, bindings] : modes) {
+		for (const auto& binding : bindings) {
+			add(roots[name], binding);
+		}
+	}
+
+	size_t capacity = 16;
+	while (capacity < 2 * transitions.size()) {
+		capacity *= 2;
+	}
+
+	m_table.resize(capacity);
+	m_mask = capacity - 1;
+	m_shift = 64 - countr_zero(capacity);
+	for (const auto& [key, target] : transitions) {
+		size_t i = hash(key);
+		size_t n_probes = 1;
+		for (; m_table[i].key != EMPTY; i = (i + 1) & m_mask) {
+			++n_probes;
+		}
+
+		m_table[i] = {key, target};
+		m_max_probes = std::max(m_max_probes, n_probes);
+	}
+}
+
+// A sequence is abandoned if its next key does not follow in time, such that a stray prefix does not swallow a key
+// that is pressed much later.
+const auto SEQUENCE_TIMEOUT = chrono::seconds{2};
+
+// Bit of the given modifier key in `m_held_modifier_keys`, or -1 for other keys. Left and right keys are told apart,
+// such that releasing one while the other is still held keeps the modifier held.
+int modifier_key_bit(UINT keycode) {
+	switch (keycode) {
+		case VK_SHIFT:
+		case VK_LSHIFT: return 0;
+		case VK_RSHIFT: return 1;
+		case VK_CONTROL:
+		case VK_LCONTROL: return 2;
+		case VK_RCONTROL: return 3;
+		case VK_MENU:
+		case VK_LMENU: return 4;
+		case VK_RMENU: return 5;
+		case VK_LWIN: return 6;
+		case VK_RWIN: return 7;
+		default: return -1;
+	}
+}
+
+UINT to_modifiers(uint32_t held_modifier_keys) {
+	UINT result = 0;
+	if (held_modifier_keys & 0b11) {
+		result |= MOD_SHIFT;
+	}
+
+	if (held_modifier_keys & 0b1100) {
+		result |= MOD_CONTROL;
+	}
+
+	if (held_modifier_keys & 0b110000) {
+		result |= MOD_ALT;
+	}
+
+	if (held_modifier_keys & 0b11000000) {
+		result |= MOD_WIN;
+	}
+
+	return result;
+}
+
+InputEngine::InputEngine() : m_event{platform().create_event()} {
+	try {
+		m_hook = platform().create_keyboard_hook([this](const KeyInput& key) { return on_key(key); });
+	} catch (...) {
+		platform().close_event(m_event);
+		throw;
+	}
+}
+
+InputEngine::~InputEngine() {
+	m_hook.reset();
+	platform().close_event(m_event);
+}
+
+void InputEngine::set_matcher(shared_ptr<const KeyMatcher> matcher) {
+	// Generations start at 1, such that the hook, which starts at 0, picks up the first matcher like any other.
+	unique_ptr<const Published> published{new Published{std::move(matcher), ++m_generation}};
+	m_active.store(published.get());
+
+	// The hook may still be resolving a key with the previous matcher, which must then stay alive until it is done.
+	// Counted after publishing, such that any key that the hook finishes from now on was the last to possibly use it.
+	if (m_published) {
+		m_retired.push_back({std::move(m_published), m_n_resolved.load()});
+	}
+
+	m_published = std::move(published);
+	collect_retired();
+}
+
+void InputEngine::collect_retired() {
+	erase_if(m_retired, [this](const Retired& retired) {
+		return !m_in_callback.load() || m_n_resolved.load() != retired.n_resolved;
+	});
+}
+
+void InputEngine::drain(const function<void(const Command&, clock::time_point)>& fn) {
+	Triggered triggered;
+	while (m_queue.try_pop(triggered)) {
+		fn(triggered.command, triggered.time);
+	}
+
+	collect_retired();
+}
+
+bool InputEngine::on_key(const KeyInput& key) {
+	// Sequentially consistent, like `set_matcher` and `collect_retired`: either they see that this key is being
+	// resolved or this key sees the matcher that they published.
+	m_in_callback.store(true);
+	bool swallow = resolve(key);
+	m_n_resolved.fetch_add(1);
+	m_in_callback.store(false);
+	return swallow;
+}
+
+bool InputEngine::resolve(const KeyInput& key) {
+	UINT keycode = key.keycode & 0xFF;
+
+	// Applications always see modifiers, such that they don't end up thinking that one is stuck.
+	if (int bit = modifier_key_bit(keycode); bit >= 0) {
+		if (key.release) {
+			m_held_modifier_keys &= ~(1u << bit);
+		} else {
+			m_held_modifier_keys |= 1u << bit;
+		}
+
+		return false;
+	}
+
+	// Applications see either both the press and the release of a key or neither.
+	if (key.release) {
+		bool swallowed = m_swallowed[keycode];
+		m_swallowed[keycode] = false;
+		return swallowed;
+	}
+
+	const auto* published = m_active.load();
+	if (!published || !published->matcher) {
+		return false;
+	}
+
+	// A new matcher's states mean something else, even if it took the place of the previous one in memory.
+	if (published->generation != m_state_generation) {
+		m_state_generation = published->generation;
+		m_state = KeyMatcher::ROOT;
+	}
+
+	const auto* matcher = published->matcher.get();
+
+	auto now = clock::now();
+	uint32_t root = matcher->root(m_state);
+	if (m_state != root && now - m_sequence_time > SEQUENCE_TIMEOUT) {
+		m_state = root;
+	}
+
+	bool swallow = true;
+	if (const auto* target = matcher->find(m_state, to_chord(to_modifiers(m_held_modifier_keys), keycode))) {
+		m_state = target->state;
+		m_sequence_time = now;
+		if (target->command >= 0) {
+			if (m_queue.try_push({matcher->commands()[target->command], now})) {
+				platform().set_event(m_event);
+			} else {
+				m_n_dropped.fetch_add(1, memory_order_relaxed);
+			}
+		}
+	} else if (m_state != root) {
+		// The key was meant to continue the sequence, so no application expects it.
+		m_state = root;
+	} else if (root != KeyMatcher::ROOT) {
+		if (keycode == VK_ESCAPE) {
+			m_state = KeyMatcher::ROOT;
+		}
+	} else {
+		swallow = false;
+	}
+
+	m_swallowed[keycode] = swallow;
+	return swallow;
+}
+
+} // namespace twm
@@ -6,35 +6,248 @@
 
 #include <tinylogger/tinylogger.h>
 
+#include <array>
+#include <atomic>
+#include <format>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
 
 using namespace std;
 
 namespace twm {
 
-auto min_severity = Severity::Info;
-
-void log(Severity severity, const string& str) {
-	if (severity < min_severity) {
-		return;
-	}
+Severity min_severity = Severity::Info;
 
+void write_message(Severity severity, const string& str) {
 	switch (severity) {
 		case Severity::Debug: tlog::debug() << str; break;
 		case Severity::Info: tlog::info() << str; break;
 		case Severity::Warning: tlog::warning() << str; break;
-		case Severity::Error: {
-			tlog::error() << str;
-			if (!GetConsoleWindow()) {
-				MessageBox(nullptr, str.c_str(), "Error", MB_OK | MB_ICONERROR);
+		case Severity::Error: tlog::error() << str; break;
+	}
+}
+
+// Errors would go unnoticed without a console, so they additionally pop up a dialog.
+bool shows_error_dialogs() {
+#ifdef _WIN32
+	return !GetConsoleWindow();
+#else
+	return false;
+#endif
+}
+
+void show_error_dialog(const string& str) {
+#ifdef _WIN32
+	MessageBox(nullptr, str.c_str(), "Error", MB_OK | MB_ICONERROR);
+#else
+	(void)str;
+#endif
+}
+
+// Bounded lock-free queue that any number of threads can push into and a single thread pops from. Each slot's
+// sequence number says whose turn it is: the producer claiming position `pos` waits for `pos`, the consumer for
+// `pos + 1`. See Dmitry Vyukov's bounded MPMC queue, of which this is the single-consumer special case.
+class LogQueue {
+public:
+	static const size_t CAPACITY = 1024;
+
+	LogQueue() {
+		for (size_t i = 0; i < CAPACITY; ++i) {
+			m_slots[i].sequence.store(i, memory_order_relaxed);
+		}
+	}
+
+	// Returns false if the queue is full.
+	bool try_push(LogRecord&& record) {
+		size_t pos = m_head.load(memory_order_relaxed);
+		Slot* slot;
+		while (true) {
+			slot = &m_slots[pos % CAPACITY];
+			auto diff = (ptrdiff_t)slot->sequence.load(memory_order_acquire) - (ptrdiff_t)pos;
+			if (diff == 0) {
+				if (m_head.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+					break;
+				}
+			} else if (diff < 0) {
+				return false;
+			} else {
+				pos = m_head.load(memory_order_relaxed);
 			}
-		} break;
+		}
+
+		slot->record = std::move(record);
+		slot->sequence.store(pos + 1, memory_order_release);
+		return true;
+	}
+
+	// Must only be called by the consumer.
+	bool try_pop(LogRecord& record) {
+		Slot& slot = m_slots[m_tail % CAPACITY];
+		if (slot.sequence.load(memory_order_acquire) != m_tail + 1) {
+			return false;
+		}
+
+		record = std::move(slot.record);
+		slot.sequence.store(m_tail + CAPACITY, memory_order_release);
+		++m_tail;
+		return true;
+	}
+
+private:
+	struct Slot {
+		atomic<size_t> sequence;
+		LogRecord record;
+	};
+
+	array<Slot, CAPACITY> m_slots;
+
+	// Producers and consumer each get their own cache line.
+	alignas(64) atomic<size_t> m_head = 0;
+	alignas(64) size_t m_tail = 0;
+};
+
+// Moves writing log messages, which may hit a slow console or file, and error dialogs, which block until the
+// user dismisses them, off the threads that log. Messages that do not fit into the queue are dropped and counted.
+class AsyncLogger {
+public:
+	AsyncLogger() : m_writer{[this]() { run(); }} {}
+
+	void log(LogRecord&& record) {
+		if (m_stopped.load(memory_order_acquire)) {
+			// The writer is gone. Only happens on exit, so write synchronously.
+			lock_guard lock{m_sync_mutex};
+			write(record);
+			return;
+		}
+
+		if (!m_queue.try_push(std::move(record))) {
+			m_n_dropped.fetch_add(1, memory_order_relaxed);
+			return;
+		}
+
+		m_n_pushed.fetch_add(1, memory_order_release);
+		m_signal.fetch_add(1, memory_order_release);
+		m_signal.notify_one();
+	}
+
+	void flush() {
+		size_t target = m_n_pushed.load(memory_order_acquire);
+		while (!m_stopped.load(memory_order_acquire)) {
+			size_t n = m_n_written.load(memory_order_acquire);
+			if (n >= target) {
+				break;
+			}
+
+			m_n_written.wait(n, memory_order_acquire);
+		}
+	}
+
+	// Writes what is still queued and waits for open error dialogs to be dismissed.
+	void stop() {
+		if (m_stopping.exchange(true)) {
+			return;
+		}
+
+		m_signal.fetch_add(1, memory_order_release);
+		m_signal.notify_one();
+		m_writer.join();
+	}
+
+	size_t n_dropped() const { return m_n_dropped.load(memory_order_relaxed); }
+
+private:
+	static void write(LogRecord& record) {
+		write_message(record.severity(), record.str());
+		if (record.severity() == Severity::Error && shows_error_dialogs()) {
+			show_error_dialog(record.str());
+		}
+	}
+
+	void run() {
+		LogRecord record;
+		size_t n_written = 0;
+		size_t n_reported_dropped = 0;
+		vector<thread> dialogs;
+
+		while (true) {
+			uint32_t signal = m_signal.load(memory_order_acquire);
+			bool stopping = m_stopping.load(memory_order_acquire);
+
+			while (m_queue.try_pop(record)) {
+				write_message(record.severity(), record.str());
+				if (record.severity() == Severity::Error && shows_error_dialogs()) {
+					// On its own thread, such that the dialog holds up neither twm nor further log messages.
+					dialogs.emplace_back(show_error_dialog, record.str());
+				}
+
+				m_n_written.store(++n_written, memory_order_release);
+				m_n_written.notify_all();
+			}
+
+			if (size_t n_dropped = m_n_dropped.load(memory_order_relaxed); n_dropped != n_reported_dropped) {
+				write_message(
+					Severity::Warning,
+					format("Dropped {} log messages: the log queue was full.", n_dropped - n_reported_dropped)
+				);
+				n_reported_dropped = n_dropped;
+			}
+
+			if (stopping) {
+				break;
+			}
+
+			m_signal.wait(signal, memory_order_acquire);
+		}
+
+		// Producers that race with stopping may still have pushed. Let them go synchronous and pick up their leftovers.
+		m_stopped.store(true, memory_order_release);
+		m_n_written.notify_all();
+		while (m_queue.try_pop(record)) {
+			write_message(record.severity(), record.str());
+		}
+
+		for (auto& dialog : dialogs) {
+			dialog.join();
+		}
+	}
+
+	LogQueue m_queue;
+
+	atomic<size_t> m_n_pushed = 0;
+	atomic<size_t> m_n_written = 0;
+	atomic<size_t> m_n_dropped = 0;
+
+	// Incremented to wake the writer.
+	atomic<uint32_t> m_signal = 0;
+	atomic<bool> m_stopping = false;
+	atomic<bool> m_stopped = false;
+
+	mutex m_sync_mutex;
+	thread m_writer;
+};
+
+// Never destroyed, such that messages logged by other static objects' destructors on exit are not lost.
+AsyncLogger& logger() {
+	static auto* logger = new AsyncLogger{};
+	return *logger;
+}
+
+// Stops the writer on exit, which flushes the queue and keeps the process alive until error dialogs are dismissed.
+struct StopLoggerOnExit {
+	~StopLoggerOnExit() { logger().stop(); }
+} stop_logger_on_exit;
+
+void log(LogRecord&& record) { logger().log(std::move(record)); }
+
+void log(Severity severity, string str) {
+	if (log_enabled(severity)) {
+		log(LogRecord{severity, std::move(str)});
 	}
 }
 
-void log_debug(const string& str) { log(Severity::Debug, str); }
-void log_info(const string& str) { log(Severity::Info, str); }
-void log_warning(const string& str) { log(Severity::Warning, str); }
-void log_error(const string& str) { log(Severity::Error, str); }
+void flush_log() { logger().flush(); }
+size_t n_dropped_log_messages() { return logger().n_dropped(); }
 
 } // namespace twm
@@ -0,0 +1,103 @@
+// This file was developed by Thomas Müller <thomas94@gmx.net>.
+// It is published under the GPU GPLv3 license; see LICENSE.txt for details.
+
+#include <twm/common.h>
+#include <twm/loop.h>
+#include <twm/platform.h>
+
+#include <algorithm>
+
+using namespace std;
+
+namespace twm {
+
+EventLoop::EventLoop() {
+	m_posted_event = platform().create_event();
+	add_handle(m_posted_event, [this]() { run_posted(); });
+}
+
+EventLoop::~EventLoop() { platform().close_event(m_posted_event); }
+
+void EventLoop::schedule(clock::time_point time, Callback callback) {
+	m_tasks.emplace_back(time, std::move(callback));
+	push_heap(m_tasks.begin(), m_tasks.end(), [](const Task& a, const Task& b) { return a.time > b.time; });
+}
+
+void EventLoop::add_handle(HANDLE handle, Callback callback) {
+	m_handles.emplace_back(handle);
+	m_handle_callbacks.emplace_back(std::move(callback));
+}
+
+void EventLoop::remove_handle(HANDLE handle) {
+	for (size_t i = 0; i < m_handles.size(); ++i) {
+		if (m_handles[i] == handle) {
+			m_handles.erase(m_handles.begin() + i);
+			m_handle_callbacks.erase(m_handle_callbacks.begin() + i);
+			return;
+		}
+	}
+}
+
+void EventLoop::post(Callback callback) {
+	{
+		lock_guard lock{m_posted_mutex};
+		m_posted.emplace_back(std::move(callback));
+	}
+
+	platform().set_event(m_posted_event);
+}
+
+void EventLoop::run_posted() {
+	vector<Callback> posted;
+	{
+		lock_guard lock{m_posted_mutex};
+		swap(posted, m_posted);
+	}
+
+	for (auto& callback : posted) {
+		callback();
+	}
+}
+
+optional<clock::duration> EventLoop::timeout() const {
+	if (m_tasks.empty()) {
+		return {};
+	}
+
+	return std::max(m_tasks.front().time - clock::now(), clock::duration::zero());
+}
+
+void EventLoop::run_due_tasks() {
+	auto now = clock::now();
+	while (!m_tasks.empty() && m_tasks.front().time <= now) {
+		pop_heap(m_tasks.begin(), m_tasks.end(), [](const Task& a, const Task& b) { return a.time > b.time; });
+		auto task = std::move(m_tasks.back());
+		m_tasks.pop_back();
+
+		// The callback may schedule new tasks, so it must only run once the heap is consistent again.
+		task.callback();
+	}
+}
+
+bool EventLoop::run_once(const MessageHandler& on_thread_message) {
+	optional<size_t> signalled = platform().wait(m_handles, timeout());
+	++m_stats.n_wakeups;
+
+	if (signalled) {
+		// Copy the callback: it may remove its own handle.
+		auto callback = m_handle_callbacks[*signalled];
+		callback();
+	}
+
+	Message msg;
+	while (platform().next_message(msg)) {
+		if (!on_thread_message(msg)) {
+			return false;
+		}
+	}
+
+	run_due_tasks();
+	return true;
+}
+
+} // namespace twm
@@ -4,241 +4,349 @@
 #include <twm/common.h>
 #include <twm/logging.h>
 #include <twm/platform.h>
+#include <twm/platform_sim.h>
+#include <twm/trace.h>
+#include <twm/worker_pool.h>
 
-#include <dwmapi.h>
-#include <winuser.h>
+#include <algorithm>
+#include <format>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
 
 using namespace std;
 
 namespace twm {
 
-int last_error_code() { return GetLastError(); }
-
-string error_string(int code) {
-	return format("{} ({})", trim(std::system_category().message(code)), code);
+// Never destroyed, such that it outlives the static objects that still use it on exit (e.g. the config's hotkeys).
+unique_ptr<Platform>& current_platform() {
+	static auto* platform = new unique_ptr<Platform>{};
+	return *platform;
 }
 
-string last_error_string() { return error_string(last_error_code()); }
+void invalidate_all_caches();
 
-bool set_window_rect(HWND handle, const Rect& r) {
-	if (SetWindowPos(
-			handle,
-			nullptr,
-			(LONG)r.top_left.x,
-			(LONG)r.top_left.y,
-			(LONG)r.size().x,
-			(LONG)r.size().y,
-			SWP_NOACTIVATE | SWP_NOOWNERZORDER | SWP_NOZORDER
-		) == 0) {
-		log_warning("Could not set rect: {}", last_error_string());
-		return false;
+Platform& platform() {
+	auto& current = current_platform();
+	if (!current) {
+#ifdef _WIN32
+		current = create_windows_platform();
+#else
+		current = make_unique<SimulatedPlatform>();
+#endif
 	}
 
-	return true;
+	return *current;
 }
 
-Rect get_window_rect(HWND handle) {
-	if (RECT r; GetWindowRect(handle, &r) == 0) {
-		throw runtime_error{format("Could not obtain rect: {}", last_error_string())};
-	} else {
-		return {r};
-	}
+void set_platform(unique_ptr<Platform> platform) {
+	invalidate_all_caches();
+	current_platform() = std::move(platform);
 }
 
-bool set_window_frame_bounds(HWND handle, const Rect& r) {
-	// In an ideal world, we would use the Windows API to directly set the
-	// window's frame bounds, but, alas, no such API function exists. As a
-	// workaround, we compute the current margin between the window's rect
-	// and frame bound and use it to derive a rect that corresponds to the
-	// target frame bounds.
-	Rect margin = get_window_rect(handle) - get_window_frame_bounds(handle);
-	return set_window_rect(handle, r + margin);
-}
-
-Rect get_window_frame_bounds(HWND handle) {
-	if (RECT r; HRESULT result = DwmGetWindowAttribute(handle, DWMWA_EXTENDED_FRAME_BOUNDS, &r, sizeof(r)) != S_OK) {
-		static bool warned = false;
-		if (!warned) {
-			log_warning(
-				"DwmGetWindowAttribute(DWMWA_EXTENDED_FRAME_BOUNDS) failed: {}. Falling back to GetWindowRect.",
-				error_string(result)
-			);
-			warned = true;
-		}
+// Never destroyed: workers that are stuck in a hung window's call can't be joined.
+WorkerPool& window_call_pool() {
+	static auto* pool = new WorkerPool{4};
+	return *pool;
+}
 
-		return get_window_rect(handle);
-	} else {
-		return {r};
+clock::duration window_call_timeout = chrono::milliseconds{200};
+
+// Windows with calls that missed their deadline and have not returned since, and how many such calls each has.
+// Shared with the workers, which clear them once the calls return.
+mutex unresponsive_mutex;
+unordered_map<HWND, size_t> unresponsive_windows;
+
+// Makes a call that needs the cooperation of the given windows' threads on a worker, see `set_window_call_timeout`.
+// Returns nothing if the call timed out or if one of the windows is still unresponsive from an earlier call.
+template <typename T> optional<T> call_windows(const char* name, const vector<HWND>& handles, function<T()> fn) {
+	{
+		lock_guard lock{unresponsive_mutex};
+		if (any_of(handles.begin(), handles.end(), [](HWND h) { return unresponsive_windows.count(h) > 0; })) {
+			return {};
+		}
 	}
+
+	auto on_hang = [name, handles]() {
+		log_warning(
+			"{} did not return within {} ms. Treating {} window(s) as unresponsive until it does.",
+			name,
+			chrono::duration_cast<chrono::milliseconds>(window_call_timeout).count(),
+			handles.size()
+		);
+
+		lock_guard lock{unresponsive_mutex};
+		for (HWND h : handles) {
+			++unresponsive_windows[h];
+		}
+	};
+
+	auto on_late_return = [handles]() {
+		lock_guard lock{unresponsive_mutex};
+		for (HWND h : handles) {
+			if (auto it = unresponsive_windows.find(h); it != unresponsive_windows.end() && --it->second == 0) {
+				unresponsive_windows.erase(it);
+			}
+		}
+	};
+
+	return window_call_pool().run(std::move(fn), clock::now() + window_call_timeout, on_hang, on_late_return);
 }
 
-void set_window_rounded_corners(HWND handle, RoundedCornerPreference rounded) {
-	static const uint32_t WINDOW_CORNER_PREFERENCE = 33;
-	DwmSetWindowAttribute(handle, WINDOW_CORNER_PREFERENCE, &rounded, sizeof(rounded));
+template <typename T> optional<T> call_window(const char* name, HWND handle, function<T()> fn) {
+	return call_windows(name, vector<HWND>{handle}, std::move(fn));
 }
 
-COLORREF to_colorref(uint32_t color) { return RGB((color >> 16) & 0xFF, (color >> 8) & 0xFF, color & 0xFF); }
+void set_window_call_timeout(clock::duration timeout) { window_call_timeout = timeout; }
 
-void set_window_border_color(HWND handle, COLORREF color) {
-	static const uint32_t BORDER_COLOR = 34;
-	DwmSetWindowAttribute(handle, BORDER_COLOR, &color, sizeof(color));
+bool is_window_responsive(HWND handle) {
+	lock_guard lock{unresponsive_mutex};
+	return unresponsive_windows.count(handle) == 0;
 }
 
-void set_system_dropshadow(bool enabled) {
-	if (!SystemParametersInfo(SPI_SETDROPSHADOW, 0, (PVOID)enabled, SPIF_SENDCHANGE)) {
-		log_warning("Could not set dropshadow: {}", last_error_string());
-	}
+vector<HWND> enumerate_windows() { return platform().enumerate_windows(); }
+HWND get_foreground_window() { return platform().foreground_window(); }
+bool is_window(HWND handle) { return platform().is_window(handle); }
+bool is_window_visible(HWND handle) { return platform().is_window_visible(handle); }
+bool is_window_minimized(HWND handle) { return platform().is_window_minimized(handle); }
+
+bool set_window_rect(HWND handle, const Rect& r) {
+	TraceSpan span{"set_window_rect"};
+	return call_window<bool>("set_window_rect", handle, [=]() { return platform().set_window_rect(handle, r); })
+		.value_or(false);
 }
+Rect get_window_rect(HWND handle) { return platform().window_rect(handle); }
 
-bool focus_window(HWND handle) { return SetForegroundWindow(handle) != 0; }
+struct FrameMargin {
+	Rect margin;
 
-string get_window_text(HWND handle) {
-	if (int name_length = GetWindowTextLengthW(handle) <= 0 || last_error_code() != 0) {
-		SetLastError(0);
-		return "";
-	} else {
-		wstring wname;
-		wname.resize(name_length + 1);
-		GetWindowTextW(handle, wname.data(), (int)wname.size());
-		return utf16_to_utf8(wname);
+	// State the margin depends on
+	WindowFrameState state;
+};
+
+unordered_map<HWND, FrameMargin> frame_margins;
+
+// Margin between the window's rect and its frame bounds. Only recomputed,
+// which takes a DWM round trip, if the window's style, DPI, or monitor
+// changed. Querying those is cheap.
+Rect get_window_frame_margin(HWND handle) {
+	WindowFrameState state = platform().window_frame_state(handle);
+	if (auto it = frame_margins.find(handle); it != frame_margins.end() && it->second.state == state) {
+		return it->second.margin;
 	}
+
+	Rect margin = get_window_rect(handle) - get_window_frame_bounds(handle);
+	frame_margins[handle] = {margin, state};
+	return margin;
 }
 
-bool terminate_process(HWND handle) {
-	if (DWORD process_id = 0; GetWindowThreadProcessId(handle, &process_id) == 0 || process_id == 0) {
-		return false;
+bool set_window_frame_bounds(HWND handle, const Rect& r) {
+	// In an ideal world, we would use the Windows API to directly set the
+	// window's frame bounds, but, alas, no such API function exists. As a
+	// workaround, we use the margin between the window's rect and frame
+	// bound to derive a rect that corresponds to the target frame bounds.
+	return set_window_rect(handle, r + get_window_frame_margin(handle));
+}
+
+Rect get_window_frame_bounds(HWND handle) { return platform().window_frame_bounds(handle); }
+
+// Unset values are unknown and always get applied.
+struct AppliedAttributes {
+	optional<RoundedCornerPreference> rounded_corners;
+	optional<COLORREF> border_color;
+};
+
+unordered_map<HWND, AppliedAttributes> applied_attributes;
+DwmAttributeStats attribute_stats;
+
+template <typename T>
+void set_window_attribute_cached(HWND handle, WindowAttribute attribute, optional<T>& applied, T value) {
+	if (applied == value) {
+		++attribute_stats.n_suppressed;
+		return;
+	}
+
+	// Remember the value even if the call fails. Windows that don't support an attribute would otherwise be asked
+	// again and again. Unless the call timed out or was skipped, though: the window may respond again later.
+	bool made = call_window<bool>("set_window_attribute", handle, [=]() {
+		platform().set_window_attribute(handle, attribute, (uint32_t)value);
+		return true;
+	}).has_value();
+
+	if (made) {
+		++attribute_stats.n_issued;
+		applied = value;
 	} else {
-		HANDLE process = OpenProcess(PROCESS_TERMINATE, 0, process_id);
-		return process && TerminateProcess(process, 0) != 0;
+		++attribute_stats.n_skipped;
 	}
 }
 
-bool close_window(HWND handle) { return PostMessage(handle, WM_CLOSE, 0, 0) != 0; }
+Rect get_primary_work_area() { return platform().primary_work_area(); }
 
-auto query_desktop_manager() {
-	const CLSID CLSID_ImmersiveShell = {
-		0xC2F03A33,
-		0x21F5,
-		0x47FA,
-		{0xB4, 0xBB, 0x15, 0x63, 0x62, 0xA2, 0xF2, 0x39}
-	};
+void GeometryTransaction::stage(HWND handle, const Rect& frame_bounds) {
+	erase_if(m_moves, [&](const auto& move) { return move.first == handle; });
 
-	IServiceProvider* service_provider = NULL;
+	try {
+		// See set_window_frame_bounds(). Comparing rects rather than frame bounds saves a DWM round trip.
+		Rect rect = frame_bounds + get_window_frame_margin(handle);
+		if (rect != get_window_rect(handle)) {
+			m_moves.emplace_back(handle, rect);
+		}
+	} catch (const runtime_error&) {
+		m_failed.emplace_back(handle);
+	}
+}
 
-	HRESULT hr = CoCreateInstance(
-		CLSID_ImmersiveShell,
-		NULL,
-		CLSCTX_LOCAL_SERVER,
-		__uuidof(IServiceProvider),
-		(PVOID*)&service_provider
-	);
+vector<HWND> GeometryTransaction::commit() {
+	auto moves = std::move(m_moves);
+	auto failed = std::move(m_failed);
+	m_moves.clear();
+	m_failed.clear();
 
-	if (FAILED(hr)) {
-		throw runtime_error{format("Failed to get immersive shell service provider: {}", std::to_string(hr))};
-	}
+	if (!moves.empty()) {
+		TraceSpan span{"set_window_rects", format("{} windows", moves.size())};
 
-	auto guard = ScopeGuard([&]() { service_provider->Release(); });
+		vector<HWND> handles;
+		for (const auto& [handle, _] : moves) {
+			handles.emplace_back(handle);
+		}
 
-	IVirtualDesktopManager* desktop_manager;
-	hr = service_provider->QueryService(__uuidof(IVirtualDesktopManager), &desktop_manager);
+		// The batch is all-or-nothing, so a single hung window holds up, and fails, all of them.
+		auto result = call_windows<vector<HWND>>("set_window_rects", handles, [moves]() {
+			return platform().set_window_rects(moves);
+		});
 
-	if (FAILED(hr)) {
-		throw runtime_error{"Failed to get virtual desktop manager."};
+		const auto& tmp = result ? *result : handles;
+		failed.insert(failed.end(), tmp.begin(), tmp.end());
 	}
 
-	SetLastError(0);
-	return desktop_manager;
+	return failed;
 }
 
-IVirtualDesktopManager* desktop_manager() {
-	static auto desktop = query_desktop_manager();
-	return desktop;
+void set_window_rounded_corners(HWND handle, RoundedCornerPreference rounded) {
+	set_window_attribute_cached(handle, WindowAttribute::CornerPreference, applied_attributes[handle].rounded_corners, rounded);
 }
 
-optional<GUID> get_window_desktop_id(HWND handle) {
-	if (
-		GUID desktop_id;
-		desktop_manager()->GetWindowDesktopId(handle, &desktop_id) != S_OK || equal_to<GUID>{}(desktop_id, GUID{})
-	) {
-		return {};
-	} else {
-		return desktop_id;
-	}
+// Same as the RGB macro of the Windows API: COLORREF stores the channels in reverse order.
+COLORREF to_colorref(uint32_t color) { return ((color >> 16) & 0xFF) | (color & 0xFF00) | ((color & 0xFF) << 16); }
+
+void set_window_border_color(HWND handle, COLORREF color) {
+	set_window_attribute_cached(handle, WindowAttribute::BorderColor, applied_attributes[handle].border_color, color);
 }
 
-bool is_window_on_current_desktop(HWND handle) {
-	BOOL is_current_desktop = 0;
-	HRESULT r = desktop_manager()->IsWindowOnCurrentVirtualDesktop(handle, &is_current_desktop);
-	return r == S_OK && is_current_desktop != 0;
+DwmAttributeStats dwm_attribute_stats() { return attribute_stats; }
+void invalidate_all_window_attributes() { applied_attributes.clear(); }
+
+// Only filled while caching is enabled
+unordered_map<HWND, optional<GUID>> desktop_ids;
+bool cache_desktop_ids = false;
+VirtualDesktopStats desktop_stats;
+
+void invalidate_window_caches(HWND handle) {
+	applied_attributes.erase(handle);
+	frame_margins.erase(handle);
+	desktop_ids.erase(handle);
 }
 
-bool move_window_to_desktop(HWND handle, const GUID& desktop_id) {
-	if (HRESULT res = desktop_manager()->MoveWindowToDesktop(handle, desktop_id) != S_OK) {
-		log_warning("Failed to move window to desktop: {}", error_string(res));
-		return false;
-	} else {
-		return true;
-	}
+void invalidate_all_caches() {
+	applied_attributes.clear();
+	frame_margins.clear();
+	desktop_ids.clear();
 }
 
-bool is_autostart_enabled() {
-	HKEY key;
-	if (HRESULT res = RegOpenKeyEx(HKEY_CURRENT_USER, "Software\\Microsoft\\Windows\\CurrentVersion\\Run", 0, KEY_READ, &key) != ERROR_SUCCESS) {
-		log_warning("Could not open registry key for reading: {}", error_string(res));
+void set_system_dropshadow(bool enabled) { platform().set_system_dropshadow(enabled); }
+
+bool focus_window(HWND handle) {
+	TraceSpan span{"focus_window"};
+
+	// Only pinging the window, which blocks while it is hung, can happen on a worker. See Platform::focus_window.
+	if (!call_window<bool>("focus_window", handle, [=]() { return platform().ping_window(handle); }).value_or(false)) {
 		return false;
 	}
 
-	auto guard = ScopeGuard([&]() { RegCloseKey(key); });
+	return platform().focus_window(handle);
+}
 
-	wchar_t registry_path[MAX_PATH];
-	DWORD n_bytes = sizeof(registry_path);
-	if (RegQueryValueExW(key, L"twm", 0, nullptr, (LPBYTE)registry_path, &n_bytes) != ERROR_SUCCESS) {
-		return false;
+string get_window_text(HWND handle) {
+	return call_window<string>("get_window_text", handle, [=]() { return platform().window_text(handle); }).value_or("");
+}
+
+bool window_has_text(HWND handle) { return platform().window_has_text(handle); }
+bool terminate_process(HWND handle) { return platform().terminate_process(handle); }
+
+bool close_window(HWND handle) {
+	return call_window<bool>("close_window", handle, [=]() { return platform().close_window(handle); }).value_or(false);
+}
+
+optional<GUID> get_window_desktop_id(HWND handle) {
+	if (auto it = desktop_ids.find(handle); it != desktop_ids.end()) {
+		++desktop_stats.n_cached;
+		return it->second;
 	}
 
-	wchar_t executable_path[MAX_PATH];
-	DWORD len = GetModuleFileNameW(nullptr, executable_path, MAX_PATH);
-	if (len == 0 || len == MAX_PATH) {
-		log_warning("Could not get module file name");
-		return false;
+	++desktop_stats.n_queries;
+	auto desktop_id = platform().window_desktop_id(handle);
+	if (cache_desktop_ids) {
+		desktop_ids[handle] = desktop_id;
 	}
 
-	return !wcscmp(registry_path, executable_path);
+	return desktop_id;
 }
 
-bool set_autostart_enabled(bool value) {
-	HKEY key;
-	if (HRESULT res = RegOpenKeyEx(HKEY_CURRENT_USER, "Software\\Microsoft\\Windows\\CurrentVersion\\Run", 0, KEY_WRITE, &key) != ERROR_SUCCESS) {
-		log_warning("Could not open registry key for writing: {}", error_string(res));
+bool is_window_on_current_desktop(HWND handle) {
+	++desktop_stats.n_queries;
+	return platform().is_window_on_current_desktop(handle);
+}
+
+bool move_window_to_desktop(HWND handle, const GUID& desktop_id) {
+	++desktop_stats.n_queries;
+	if (!platform().move_window_to_desktop(handle, desktop_id)) {
 		return false;
 	}
 
-	auto guard = ScopeGuard([&]() { RegCloseKey(key); });
+	if (cache_desktop_ids) {
+		desktop_ids[handle] = desktop_id;
+	}
 
-	if (value) {
-		log_debug("Enabling autostart");
+	return true;
+}
 
-		wchar_t path[MAX_PATH];
-		DWORD len = GetModuleFileNameW(nullptr, path, MAX_PATH);
-		if (len == 0 || len == MAX_PATH) {
-			log_warning("Could not get module file name");
-			return false;
-		}
+bool desktop_manager_warned = false;
 
-		if (HRESULT res = RegSetValueExW(key, L"twm", 0, REG_SZ, (const BYTE*)path, sizeof(wchar_t) * (len + 1)) != ERROR_SUCCESS) {
-			log_warning("Could not set registry value: {}", error_string(res));
-			return false;
+optional<VirtualDesktops> get_virtual_desktops() {
+	++desktop_stats.n_queries;
+	try {
+		return platform().virtual_desktops();
+	} catch (const runtime_error& e) {
+		if (!desktop_manager_warned) {
+			log_warning("Switching desktops through keyboard shortcuts: {}", e.what());
+			desktop_manager_warned = true;
 		}
-	} else {
-		log_debug("Disabling autostart");
 
-		if (HRESULT res = RegDeleteValueW(key, L"twm") != ERROR_SUCCESS) {
-			log_warning("Could not delete registry value: {}", error_string(res));
-			return false;
-		}
+		return {};
 	}
+}
 
-	return true;
+bool switch_to_desktop(const GUID& desktop_id) {
+	++desktop_stats.n_queries;
+	try {
+		platform().switch_to_desktop(desktop_id);
+		return true;
+	} catch (const runtime_error& e) {
+		log_warning("Failed to switch desktops: {}", e.what());
+		return false;
+	}
+}
+
+void set_desktop_id_caching(bool enabled) {
+	cache_desktop_ids = enabled;
+	desktop_ids.clear();
 }
 
+void invalidate_window_desktop_id(HWND handle) { desktop_ids.erase(handle); }
+VirtualDesktopStats virtual_desktop_stats() { return desktop_stats; }
+
+bool is_autostart_enabled() { return platform().is_autostart_enabled(); }
+bool set_autostart_enabled(bool value) { return platform().set_autostart_enabled(value); }
+
 } // namespace twm
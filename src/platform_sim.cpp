@@ -0,0 +1,720 @@
+// This file was developed by Thomas Müller <thomas94@gmx.net>.
+// It is published under the GPU GPLv3 license; see LICENSE.txt for details.
+
+#include <twm/common.h>
+#include <twm/platform_sim.h>
+
+#include <algorithm>
+#include <format>
+
+using namespace std;
+
+namespace twm {
+
+class SimulatedEventSource : public WindowEventSource {
+public:
+	SimulatedEventSource(SimulatedPlatform& platform) : m_platform{platform} {}
+
+	~SimulatedEventSource() {
+		lock_guard lock{m_platform.m_mutex};
+		m_platform.m_has_event_source = false;
+		m_platform.m_events.clear();
+	}
+
+	void drain(vector<WindowEvent>& events) override { m_platform.drain_events(events); }
+
+private:
+	SimulatedPlatform& m_platform;
+};
+
+class SimulatedDesktopSwitchSource : public DesktopSwitchSource {
+public:
+	SimulatedDesktopSwitchSource(SimulatedPlatform& platform, HANDLE handle) : m_platform{platform}, m_handle{handle} {}
+
+	~SimulatedDesktopSwitchSource() {
+		lock_guard lock{m_platform.m_mutex};
+		m_platform.m_desktop_switch_handle = nullptr;
+		m_platform.m_signalled.erase(m_handle);
+	}
+
+	HANDLE handle() const override { return m_handle; }
+
+	// Every switch signals the handle.
+	void rearm() override {}
+
+	optional<GUID> current_desktop() override {
+		m_platform.simulate_call(SimulatedCall::VirtualDesktop);
+		lock_guard lock{m_platform.m_mutex};
+		return m_platform.m_current_desktop;
+	}
+
+private:
+	SimulatedPlatform& m_platform;
+	HANDLE m_handle;
+};
+
+class SimulatedDirectoryChangeSource : public DirectoryChangeSource {
+public:
+	SimulatedDirectoryChangeSource(SimulatedPlatform& platform, HANDLE handle) :
+		m_platform{platform}, m_handle{handle} {}
+
+	~SimulatedDirectoryChangeSource() {
+		lock_guard lock{m_platform.m_mutex};
+		m_platform.m_directory_watches.erase(m_handle);
+		m_platform.m_signalled.erase(m_handle);
+	}
+
+	HANDLE handle() const override { return m_handle; }
+
+	// Simulated handles reset themselves.
+	void rearm() override {}
+
+private:
+	SimulatedPlatform& m_platform;
+	HANDLE m_handle;
+};
+
+class SimulatedKeyboardHook : public KeyboardHook {
+public:
+	SimulatedKeyboardHook(SimulatedPlatform& platform, HANDLE handle) : m_platform{platform}, m_handle{handle} {}
+
+	~SimulatedKeyboardHook() {
+		lock_guard lock{m_platform.m_mutex};
+		m_platform.m_keyboard_hooks.erase(m_handle);
+	}
+
+private:
+	SimulatedPlatform& m_platform;
+	HANDLE m_handle;
+};
+
+SimulatedPlatform::SimulatedPlatform() : m_input_thread{this_thread::get_id()} {
+	m_current_desktop = create_desktop();
+}
+
+HWND SimulatedPlatform::create_window(const string& title, const Rect& frame_bounds, optional<GUID> desktop_id) {
+	lock_guard lock{m_mutex};
+
+	HWND handle = (HWND)m_next_handle++;
+	m_windows[handle] = {
+		.title = title,
+		.frame_bounds = frame_bounds,
+		.margin = m_frame_margin,
+		.desktop_id = desktop_id.value_or(m_current_desktop),
+	};
+
+	// New windows open on top, but don't necessarily get focus.
+	m_z_order.insert(m_z_order.begin(), handle);
+
+	emit(WindowEventType::Created, handle);
+	emit(WindowEventType::Shown, handle);
+	return handle;
+}
+
+void SimulatedPlatform::destroy_window(HWND handle) {
+	lock_guard lock{m_mutex};
+	remove(handle);
+}
+
+void SimulatedPlatform::set_window_title(HWND handle, const string& title) {
+	lock_guard lock{m_mutex};
+	window(handle).title = title;
+	emit(WindowEventType::NameChanged, handle);
+}
+
+void SimulatedPlatform::move_window(HWND handle, const Rect& frame_bounds) {
+	lock_guard lock{m_mutex};
+	window(handle).frame_bounds = frame_bounds;
+	emit(WindowEventType::LocationChanged, handle);
+}
+
+void SimulatedPlatform::set_window_visible(HWND handle, bool visible) {
+	lock_guard lock{m_mutex};
+	window(handle).visible = visible;
+	emit(visible ? WindowEventType::Shown : WindowEventType::Hidden, handle);
+}
+
+void SimulatedPlatform::set_window_minimized(HWND handle, bool minimized) {
+	lock_guard lock{m_mutex};
+	window(handle).minimized = minimized;
+	emit(minimized ? WindowEventType::Minimized : WindowEventType::Restored, handle);
+}
+
+void SimulatedPlatform::set_window_dpi(HWND handle, uint32_t dpi) {
+	lock_guard lock{m_mutex};
+	auto& w = window(handle);
+
+	// Windows scale their decorations along with the content.
+	w.margin = Rect{w.margin.top_left * (float)dpi / (float)w.dpi, w.margin.bottom_right * (float)dpi / (float)w.dpi};
+	w.dpi = dpi;
+	emit(WindowEventType::LocationChanged, handle);
+}
+
+void SimulatedPlatform::activate_window(HWND handle) {
+	lock_guard lock{m_mutex};
+	activate(handle);
+}
+
+void SimulatedPlatform::set_window_hung(HWND handle, bool hung) {
+	lock_guard lock{m_mutex};
+	if (hung) {
+		m_hung.insert(handle);
+	} else {
+		m_hung.erase(handle);
+		m_cv.notify_all();
+	}
+}
+
+optional<uint32_t> SimulatedPlatform::window_attribute(HWND handle, WindowAttribute attribute) const {
+	lock_guard lock{m_mutex};
+	auto it = m_windows.find(handle);
+	if (it == m_windows.end() || !it->second.attributes.contains(attribute)) {
+		return {};
+	}
+
+	return it->second.attributes.at(attribute);
+}
+
+GUID SimulatedPlatform::create_desktop() {
+	lock_guard lock{m_mutex};
+	GUID id = {};
+	id.Data1 = (uint32_t)m_desktops.size() + 1;
+	m_desktops.emplace_back(id);
+	return id;
+}
+
+void SimulatedPlatform::switch_desktop(const GUID& desktop_id) {
+	lock_guard lock{m_mutex};
+	show_desktop(desktop_id);
+}
+
+GUID SimulatedPlatform::current_desktop() const {
+	lock_guard lock{m_mutex};
+	return m_current_desktop;
+}
+
+void SimulatedPlatform::post_hotkey(int id) {
+	lock_guard lock{m_mutex};
+	m_messages.push_back({.type = MessageType::Hotkey, .hotkey_id = id, .posted = clock::now()});
+	m_cv.notify_all();
+}
+
+void SimulatedPlatform::post_quit() {
+	lock_guard lock{m_mutex};
+	m_messages.push_back({.type = MessageType::Quit, .posted = clock::now()});
+	m_cv.notify_all();
+}
+
+void SimulatedPlatform::notify_directory_changed(const filesystem::path& dir) {
+	lock_guard lock{m_mutex};
+	for (const auto& [handle, watched] : m_directory_watches) {
+		if (watched == dir) {
+			m_signalled.insert(handle);
+		}
+	}
+
+	m_cv.notify_all();
+}
+
+bool SimulatedPlatform::simulate_key(const KeyInput& key) {
+	// The hooks are called without the mutex held, such that they can use the platform.
+	vector<const function<bool(const KeyInput&)>*> hooks;
+	{
+		lock_guard lock{m_mutex};
+		for (auto it = m_keyboard_hooks.rbegin(); it != m_keyboard_hooks.rend(); ++it) {
+			hooks.emplace_back(&it->second);
+		}
+	}
+
+	for (const auto* hook : hooks) {
+		if ((*hook)(key)) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+HANDLE SimulatedPlatform::create_handle() {
+	lock_guard lock{m_mutex};
+	return (HANDLE)m_next_handle++;
+}
+
+void SimulatedPlatform::signal(HANDLE handle) {
+	lock_guard lock{m_mutex};
+	m_signalled.insert(handle);
+	m_cv.notify_all();
+}
+
+void SimulatedPlatform::set_latency(SimulatedCall call, clock::duration latency) {
+	m_latencies[(size_t)call] = latency.count();
+}
+
+void SimulatedPlatform::reset_call_counts() {
+	for (auto& count : m_call_counts) {
+		count = 0;
+	}
+}
+
+unordered_map<int, pair<UINT, UINT>> SimulatedPlatform::registered_hotkeys() const {
+	lock_guard lock{m_mutex};
+	return m_hotkeys;
+}
+
+vector<KeyInput> SimulatedPlatform::sent_input() const {
+	lock_guard lock{m_mutex};
+	return m_sent_input;
+}
+
+vector<vector<HWND>> SimulatedPlatform::position_batches() const {
+	lock_guard lock{m_mutex};
+	return m_position_batches;
+}
+
+vector<HWND> SimulatedPlatform::enumerate_windows() {
+	simulate_call(SimulatedCall::WindowQuery);
+	lock_guard lock{m_mutex};
+	return m_z_order;
+}
+
+HWND SimulatedPlatform::foreground_window() {
+	simulate_call(SimulatedCall::WindowQuery);
+	lock_guard lock{m_mutex};
+	return m_foreground;
+}
+
+bool SimulatedPlatform::is_window(HWND handle) {
+	simulate_call(SimulatedCall::WindowQuery);
+	lock_guard lock{m_mutex};
+	return m_windows.count(handle) > 0;
+}
+
+bool SimulatedPlatform::is_window_visible(HWND handle) {
+	simulate_call(SimulatedCall::WindowQuery);
+	lock_guard lock{m_mutex};
+	auto it = m_windows.find(handle);
+	return it != m_windows.end() && it->second.visible;
+}
+
+bool SimulatedPlatform::is_window_minimized(HWND handle) {
+	simulate_call(SimulatedCall::WindowQuery);
+	lock_guard lock{m_mutex};
+	auto it = m_windows.find(handle);
+	return it != m_windows.end() && it->second.minimized;
+}
+
+string SimulatedPlatform::window_text(HWND handle) {
+	simulate_call(SimulatedCall::WindowText);
+	wait_while_hung(handle);
+	lock_guard lock{m_mutex};
+	auto it = m_windows.find(handle);
+	return it != m_windows.end() ? it->second.title : "";
+}
+
+bool SimulatedPlatform::window_has_text(HWND handle) {
+	// Like InternalGetWindowText, answered without the window's involvement.
+	simulate_call(SimulatedCall::WindowQuery);
+	lock_guard lock{m_mutex};
+	auto it = m_windows.find(handle);
+	return it != m_windows.end() && !it->second.title.empty();
+}
+
+Rect SimulatedPlatform::window_rect(HWND handle) {
+	simulate_call(SimulatedCall::WindowQuery);
+	lock_guard lock{m_mutex};
+	const auto& w = window(handle);
+	return w.frame_bounds + w.margin;
+}
+
+Rect SimulatedPlatform::window_frame_bounds(HWND handle) {
+	simulate_call(SimulatedCall::Dwm);
+	lock_guard lock{m_mutex};
+	return window(handle).frame_bounds;
+}
+
+WindowFrameState SimulatedPlatform::window_frame_state(HWND handle) {
+	simulate_call(SimulatedCall::WindowQuery);
+	lock_guard lock{m_mutex};
+	return {.dpi = window(handle).dpi};
+}
+
+bool SimulatedPlatform::set_rect(HWND handle, const Rect& rect) {
+	auto it = m_windows.find(handle);
+	if (it == m_windows.end()) {
+		return false;
+	}
+
+	it->second.frame_bounds = rect - it->second.margin;
+	emit(WindowEventType::LocationChanged, handle);
+	return true;
+}
+
+bool SimulatedPlatform::set_window_rect(HWND handle, const Rect& rect) {
+	simulate_call(SimulatedCall::Positioning);
+	wait_while_hung(handle);
+
+	lock_guard lock{m_mutex};
+	return set_rect(handle, rect);
+}
+
+vector<HWND> SimulatedPlatform::set_window_rects(const vector<pair<HWND, Rect>>& rects) {
+	simulate_call(SimulatedCall::Positioning);
+	for (const auto& [handle, _] : rects) {
+		wait_while_hung(handle);
+	}
+
+	lock_guard lock{m_mutex};
+
+	auto& batch = m_position_batches.emplace_back();
+	vector<HWND> failed;
+	for (const auto& [handle, rect] : rects) {
+		batch.emplace_back(handle);
+		if (!set_rect(handle, rect)) {
+			failed.emplace_back(handle);
+		}
+	}
+
+	return failed;
+}
+
+bool SimulatedPlatform::ping_window(HWND handle) {
+	simulate_call(SimulatedCall::WindowQuery);
+	wait_while_hung(handle);
+	lock_guard lock{m_mutex};
+	return m_windows.count(handle) > 0;
+}
+
+bool SimulatedPlatform::focus_window(HWND handle) {
+	// Like SetForegroundWindow, doesn't wait for the window's thread.
+	simulate_call(SimulatedCall::WindowAction);
+	lock_guard lock{m_mutex};
+	if (m_windows.count(handle) == 0 || this_thread::get_id() != m_input_thread) {
+		return false;
+	}
+
+	activate(handle);
+	return true;
+}
+
+bool SimulatedPlatform::close_window(HWND handle) {
+	simulate_call(SimulatedCall::WindowAction);
+	wait_while_hung(handle);
+	lock_guard lock{m_mutex};
+
+	// Simulated applications comply right away.
+	return remove(handle);
+}
+
+bool SimulatedPlatform::terminate_process(HWND handle) { return close_window(handle); }
+
+void SimulatedPlatform::set_window_attribute(HWND handle, WindowAttribute attribute, uint32_t value) {
+	simulate_call(SimulatedCall::Dwm);
+	wait_while_hung(handle);
+	lock_guard lock{m_mutex};
+	if (auto it = m_windows.find(handle); it != m_windows.end()) {
+		it->second.attributes[attribute] = value;
+	}
+}
+
+Rect SimulatedPlatform::primary_work_area() {
+	simulate_call(SimulatedCall::WindowQuery);
+	lock_guard lock{m_mutex};
+	return m_work_area;
+}
+
+optional<GUID> SimulatedPlatform::window_desktop_id(HWND handle) {
+	simulate_call(SimulatedCall::VirtualDesktop);
+	lock_guard lock{m_mutex};
+	auto it = m_windows.find(handle);
+	return it != m_windows.end() ? optional{it->second.desktop_id} : nullopt;
+}
+
+bool SimulatedPlatform::is_window_on_current_desktop(HWND handle) {
+	simulate_call(SimulatedCall::VirtualDesktop);
+	lock_guard lock{m_mutex};
+	auto it = m_windows.find(handle);
+	return it != m_windows.end() && equal_to<GUID>{}(it->second.desktop_id, m_current_desktop);
+}
+
+bool SimulatedPlatform::move_window_to_desktop(HWND handle, const GUID& desktop_id) {
+	simulate_call(SimulatedCall::VirtualDesktop);
+	lock_guard lock{m_mutex};
+	auto it = m_windows.find(handle);
+	if (it == m_windows.end() || find_if(m_desktops.begin(), m_desktops.end(), [&](const GUID& id) {
+									 return equal_to<GUID>{}(id, desktop_id);
+								 }) == m_desktops.end()) {
+		return false;
+	}
+
+	// Moving a window from or to the current desktop (un)cloaks it.
+	bool was_current = equal_to<GUID>{}(it->second.desktop_id, m_current_desktop);
+	bool is_current = equal_to<GUID>{}(desktop_id, m_current_desktop);
+	it->second.desktop_id = desktop_id;
+	if (was_current != is_current) {
+		emit(is_current ? WindowEventType::Uncloaked : WindowEventType::Cloaked, handle);
+	}
+
+	return true;
+}
+
+void SimulatedPlatform::register_hotkey(int id, UINT modifiers, UINT keycode) {
+	simulate_call(SimulatedCall::Input);
+	lock_guard lock{m_mutex};
+	for (const auto& [other_id, combo] : m_hotkeys) {
+		if (combo == pair{modifiers, keycode}) {
+			throw runtime_error{format("Hotkey is already registered with ID {}", other_id)};
+		}
+	}
+
+	m_hotkeys[id] = {modifiers, keycode};
+}
+
+void SimulatedPlatform::unregister_hotkey(int id) {
+	simulate_call(SimulatedCall::Input);
+	lock_guard lock{m_mutex};
+	m_hotkeys.erase(id);
+}
+
+void SimulatedPlatform::send_input(const vector<KeyInput>& inputs) {
+	simulate_call(SimulatedCall::Input);
+	lock_guard lock{m_mutex};
+	m_sent_input.insert(m_sent_input.end(), inputs.begin(), inputs.end());
+
+	auto held = [this](initializer_list<UINT> keys) {
+		return any_of(keys.begin(), keys.end(), [this](UINT key) { return m_held_keys.contains(key); });
+	};
+
+	for (const auto& input : inputs) {
+		if (input.release) {
+			m_held_keys.erase(input.keycode);
+			continue;
+		}
+
+		m_held_keys.insert(input.keycode);
+
+		// The shell's shortcuts for switching to the adjacent desktop, which don't wrap around
+		bool ctrl_win = held({VK_CONTROL, VK_LCONTROL, VK_RCONTROL}) && held({VK_LWIN, VK_RWIN});
+		if (ctrl_win && (input.keycode == VK_LEFT || input.keycode == VK_RIGHT)) {
+			auto it = find_if(m_desktops.begin(), m_desktops.end(), [this](const GUID& id) {
+				return equal_to<GUID>{}(id, m_current_desktop);
+			});
+
+			if (input.keycode == VK_LEFT && it != m_desktops.begin()) {
+				show_desktop(*prev(it));
+			} else if (input.keycode == VK_RIGHT && it != m_desktops.end() && next(it) != m_desktops.end()) {
+				show_desktop(*next(it));
+			}
+		}
+	}
+}
+
+VirtualDesktops SimulatedPlatform::virtual_desktops() {
+	simulate_call(SimulatedCall::VirtualDesktop);
+	if (!m_desktop_manager_available) {
+		throw runtime_error{"Desktop manager unavailable"};
+	}
+
+	lock_guard lock{m_mutex};
+	VirtualDesktops result = {m_desktops};
+	for (size_t i = 0; i < m_desktops.size(); ++i) {
+		if (equal_to<GUID>{}(m_desktops[i], m_current_desktop)) {
+			result.current = i;
+		}
+	}
+
+	return result;
+}
+
+void SimulatedPlatform::switch_to_desktop(const GUID& desktop_id) {
+	simulate_call(SimulatedCall::VirtualDesktop);
+	if (!m_desktop_manager_available) {
+		throw runtime_error{"Desktop manager unavailable"};
+	}
+
+	lock_guard lock{m_mutex};
+	auto is_desktop = [&](const GUID& id) { return equal_to<GUID>{}(id, desktop_id); };
+	if (none_of(m_desktops.begin(), m_desktops.end(), is_desktop)) {
+		throw runtime_error{"Desktop does not exist"};
+	}
+
+	show_desktop(desktop_id);
+}
+
+unique_ptr<WindowEventSource> SimulatedPlatform::create_window_event_source() {
+	lock_guard lock{m_mutex};
+	if (m_has_event_source) {
+		throw runtime_error{"Only one window event source can be active at a time"};
+	}
+
+	m_has_event_source = true;
+	return make_unique<SimulatedEventSource>(*this);
+}
+
+unique_ptr<DesktopSwitchSource> SimulatedPlatform::create_desktop_switch_source() {
+	lock_guard lock{m_mutex};
+	if (m_desktop_switch_handle) {
+		throw runtime_error{"Only one desktop switch source can be active at a time"};
+	}
+
+	m_desktop_switch_handle = (HANDLE)m_next_handle++;
+	return make_unique<SimulatedDesktopSwitchSource>(*this, m_desktop_switch_handle);
+}
+
+unique_ptr<DirectoryChangeSource> SimulatedPlatform::create_directory_change_source(const filesystem::path& dir) {
+	lock_guard lock{m_mutex};
+	auto handle = (HANDLE)m_next_handle++;
+	m_directory_watches[handle] = dir;
+	return make_unique<SimulatedDirectoryChangeSource>(*this, handle);
+}
+
+unique_ptr<KeyboardHook> SimulatedPlatform::create_keyboard_hook(function<bool(const KeyInput&)> on_key) {
+	lock_guard lock{m_mutex};
+	auto handle = (HANDLE)m_next_handle++;
+	m_keyboard_hooks[handle] = std::move(on_key);
+	return make_unique<SimulatedKeyboardHook>(*this, handle);
+}
+
+void SimulatedPlatform::close_event(HANDLE handle) {
+	lock_guard lock{m_mutex};
+	m_signalled.erase(handle);
+}
+
+optional<size_t> SimulatedPlatform::wait(const vector<HANDLE>& handles, optional<clock::duration> timeout) {
+	unique_lock lock{m_mutex};
+
+	auto is_signalled = [&](HANDLE h) { return m_signalled.count(h) > 0; };
+	auto ready = [&]() {
+		return !m_messages.empty() || !m_events.empty() || any_of(handles.begin(), handles.end(), is_signalled);
+	};
+
+	if (timeout) {
+		m_cv.wait_for(lock, *timeout, ready);
+	} else {
+		m_cv.wait(lock, ready);
+	}
+
+	// Handles behave like auto-reset events: waking up on one resets it.
+	for (size_t i = 0; i < handles.size(); ++i) {
+		if (m_signalled.erase(handles[i]) > 0) {
+			return i;
+		}
+	}
+
+	return {};
+}
+
+bool SimulatedPlatform::next_message(Message& message) {
+	lock_guard lock{m_mutex};
+	m_input_thread = this_thread::get_id();
+	if (m_messages.empty()) {
+		return false;
+	}
+
+	message = m_messages.front();
+	m_messages.pop_front();
+	return true;
+}
+
+void SimulatedPlatform::simulate_call(SimulatedCall call) {
+	++m_call_counts[(size_t)call];
+
+	// Busy-wait rather than sleep: sleeping is far too coarse for the microsecond-scale latencies of most calls.
+	if (auto latency = clock::duration{m_latencies[(size_t)call]}; latency > clock::duration::zero()) {
+		auto until = clock::now() + latency;
+		while (clock::now() < until) {}
+	}
+}
+
+void SimulatedPlatform::wait_while_hung(HWND handle) {
+	unique_lock lock{m_mutex};
+	m_cv.wait(lock, [&]() { return m_hung.count(handle) == 0; });
+}
+
+SimulatedPlatform::SimulatedWindow& SimulatedPlatform::window(HWND handle) {
+	auto it = m_windows.find(handle);
+	if (it == m_windows.end()) {
+		throw runtime_error{"Window does not exist"};
+	}
+
+	return it->second;
+}
+
+void SimulatedPlatform::activate(HWND handle) {
+	// Activating a window on another desktop switches to that desktop.
+	set_current_desktop(window(handle).desktop_id);
+	m_foreground = handle;
+
+	erase(m_z_order, handle);
+	m_z_order.insert(m_z_order.begin(), handle);
+
+	emit(WindowEventType::Foreground, handle);
+}
+
+void SimulatedPlatform::show_desktop(const GUID& desktop_id) {
+	set_current_desktop(desktop_id);
+	for (HWND handle : m_z_order) {
+		const auto& w = m_windows.at(handle);
+		if (equal_to<GUID>{}(w.desktop_id, desktop_id) && w.visible && !w.minimized) {
+			activate(handle);
+			return;
+		}
+	}
+
+	m_foreground = nullptr;
+}
+
+void SimulatedPlatform::set_current_desktop(const GUID& desktop_id) {
+	if (equal_to<GUID>{}(desktop_id, m_current_desktop)) {
+		return;
+	}
+
+	for (const auto& [handle, w] : m_windows) {
+		if (equal_to<GUID>{}(w.desktop_id, m_current_desktop)) {
+			emit(WindowEventType::Cloaked, handle);
+		} else if (equal_to<GUID>{}(w.desktop_id, desktop_id)) {
+			emit(WindowEventType::Uncloaked, handle);
+		}
+	}
+
+	m_current_desktop = desktop_id;
+
+	if (m_desktop_switch_handle) {
+		m_signalled.insert(m_desktop_switch_handle);
+		m_cv.notify_all();
+	}
+}
+
+bool SimulatedPlatform::remove(HWND handle) {
+	if (m_windows.erase(handle) == 0) {
+		return false;
+	}
+
+	erase(m_z_order, handle);
+	if (m_foreground == handle) {
+		m_foreground = nullptr;
+	}
+
+	emit(WindowEventType::Destroyed, handle);
+	return true;
+}
+
+void SimulatedPlatform::emit(WindowEventType type, HWND handle) {
+	// Nobody would ever drain the events otherwise.
+	if (!m_has_event_source) {
+		return;
+	}
+
+	// Mirror the coalescing of the WinEvent hook source.
+	if (WindowEvent e = {type, handle}; m_events.empty() || m_events.back() != e) {
+		m_events.emplace_back(e);
+		m_cv.notify_all();
+	}
+}
+
+void SimulatedPlatform::drain_events(vector<WindowEvent>& events) {
+	lock_guard lock{m_mutex};
+	events.insert(events.end(), m_events.begin(), m_events.end());
+	m_events.clear();
+}
+
+} // namespace twm
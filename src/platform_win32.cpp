@@ -0,0 +1,966 @@
+// This file was developed by Thomas Müller <thomas94@gmx.net>.
+// It is published under the GPU GPLv3 license; see LICENSE.txt for details.
+
+#include <twm/common.h>
+#include <twm/events.h>
+#include <twm/logging.h>
+#include <twm/platform.h>
+
+#include <dwmapi.h>
+#include <winuser.h>
+
+#include <algorithm>
+#include <atomic>
+#include <format>
+#include <future>
+#include <thread>
+
+using namespace std;
+
+namespace twm {
+
+int last_error_code() { return GetLastError(); }
+
+string error_string(int code) {
+	return format("{} ({})", trim(std::system_category().message(code)), code);
+}
+
+string last_error_string() { return error_string(last_error_code()); }
+
+// Undocumented interfaces of the shell that switch virtual desktops, for which Windows has no public API. Their IIDs
+// change with Windows versions, which each have their own declaration of the methods below. The methods that twm
+// calls kept their place in the vtable across the versions in DESKTOP_MANAGER_VERSIONS, so these declarations stop
+// where they differ. Versions that are not listed, e.g. Windows 11 21H2 and 22H2, whose methods take an extra
+// monitor, fall back to keyboard shortcuts.
+struct IApplicationView;
+
+struct IVirtualDesktop : public IUnknown {
+	virtual HRESULT STDMETHODCALLTYPE IsViewVisible(IApplicationView* view, BOOL* visible) = 0;
+	virtual HRESULT STDMETHODCALLTYPE GetId(GUID* id) = 0;
+};
+
+struct IVirtualDesktopManagerInternal : public IUnknown {
+	virtual HRESULT STDMETHODCALLTYPE GetCount(UINT* count) = 0;
+	virtual HRESULT STDMETHODCALLTYPE MoveViewToDesktop(IApplicationView* view, IVirtualDesktop* desktop) = 0;
+	virtual HRESULT STDMETHODCALLTYPE CanViewMoveDesktops(IApplicationView* view, BOOL* can_move) = 0;
+	virtual HRESULT STDMETHODCALLTYPE GetCurrentDesktop(IVirtualDesktop** desktop) = 0;
+	virtual HRESULT STDMETHODCALLTYPE GetDesktops(IObjectArray** desktops) = 0;
+	virtual HRESULT STDMETHODCALLTYPE
+		GetAdjacentDesktop(IVirtualDesktop* from, int direction, IVirtualDesktop** desktop) = 0;
+	virtual HRESULT STDMETHODCALLTYPE SwitchDesktop(IVirtualDesktop* desktop) = 0;
+};
+
+struct DesktopManagerVersion {
+	const char* windows;
+	IID manager;
+	IID desktop;
+};
+
+const DesktopManagerVersion DESKTOP_MANAGER_VERSIONS[] = {
+	{"11 24H2",
+	 {0x53F5CA0B, 0x158F, 0x4124, {0x90, 0x0C, 0x05, 0x71, 0x58, 0x06, 0x0B, 0x27}},
+	 {0x3F07F4BE, 0xB107, 0x441A, {0xAF, 0x0F, 0x39, 0xD8, 0x25, 0x29, 0x07, 0x2C}}},
+	{"11 23H2",
+	 {0xA3175F2D, 0x239C, 0x4BD2, {0x8A, 0xA0, 0xEE, 0xBA, 0x8B, 0x0B, 0x13, 0x8E}},
+	 {0x3F07F4BE, 0xB107, 0x441A, {0xAF, 0x0F, 0x39, 0xD8, 0x25, 0x29, 0x07, 0x2C}}},
+	{"10",
+	 {0xF31574D6, 0xB682, 0x4CDC, {0xBD, 0x56, 0x18, 0x27, 0x86, 0x0A, 0xBE, 0xC6}},
+	 {0xFF72FFDD, 0xBE7E, 0x43FC, {0x9C, 0x03, 0xAD, 0x81, 0x68, 0x1E, 0x88, 0xE4}}},
+};
+
+// Event source backed by out-of-context WinEvent hooks. Windows delivers
+// the events through the message queue of the thread that created the
+// source, so that thread must keep pumping messages.
+class WinEventHookSource : public WindowEventSource {
+public:
+	WinEventHookSource();
+	~WinEventHookSource();
+
+	WinEventHookSource(const WinEventHookSource& other) = delete;
+	WinEventHookSource& operator=(const WinEventHookSource& other) = delete;
+
+	void drain(vector<WindowEvent>& events) override;
+
+private:
+	static void CALLBACK callback(
+		HWINEVENTHOOK hook, DWORD event, HWND handle, LONG object_id, LONG child_id, DWORD thread_id, DWORD time
+	);
+
+	vector<HWINEVENTHOOK> m_hooks;
+	vector<WindowEvent> m_pending;
+};
+
+// WinEvent callbacks carry no user pointer, so the active source has to be
+// reachable globally. There is never more than one.
+WinEventHookSource* active_event_source = nullptr;
+
+WinEventHookSource::WinEventHookSource() {
+	if (active_event_source) {
+		throw runtime_error{"Only one window event source can be active at a time"};
+	}
+
+	// Hook only the narrow ranges we care about. Otherwise we would be woken
+	// up by the flood of unrelated accessibility events (caret, selection, ...).
+	static const pair<DWORD, DWORD> event_ranges[] = {
+		{EVENT_SYSTEM_FOREGROUND,     EVENT_SYSTEM_FOREGROUND   },
+		{EVENT_SYSTEM_MINIMIZESTART,  EVENT_SYSTEM_MINIMIZEEND  },
+		{EVENT_OBJECT_CREATE,         EVENT_OBJECT_HIDE         },
+		{EVENT_OBJECT_LOCATIONCHANGE, EVENT_OBJECT_NAMECHANGE   },
+		{EVENT_OBJECT_CLOAKED,        EVENT_OBJECT_UNCLOAKED    },
+	};
+
+	auto guard = ScopeGuard([this]() {
+		for (auto hook : m_hooks) {
+			UnhookWinEvent(hook);
+		}
+	});
+
+	for (auto [first, last] : event_ranges) {
+		HWINEVENTHOOK hook =
+			SetWinEventHook(first, last, nullptr, callback, 0, 0, WINEVENT_OUTOFCONTEXT | WINEVENT_SKIPOWNPROCESS);
+
+		if (!hook) {
+			throw runtime_error{format("Failed to install window event hook: {}", last_error_string())};
+		}
+
+		m_hooks.emplace_back(hook);
+	}
+
+	guard.disarm();
+	active_event_source = this;
+}
+
+WinEventHookSource::~WinEventHookSource() {
+	for (auto hook : m_hooks) {
+		UnhookWinEvent(hook);
+	}
+
+	active_event_source = nullptr;
+}
+
+void WinEventHookSource::drain(vector<WindowEvent>& events) {
+	events.insert(events.end(), m_pending.begin(), m_pending.end());
+	m_pending.clear();
+}
+
+void CALLBACK WinEventHookSource::callback(HWINEVENTHOOK, DWORD event, HWND handle, LONG object_id, LONG child_id, DWORD, DWORD) {
+	// Only events concerning windows themselves are of interest -- not those of their child UI elements.
+	if (!active_event_source || !handle || object_id != OBJID_WINDOW || child_id != CHILDID_SELF) {
+		return;
+	}
+
+	WindowEventType type;
+	switch (event) {
+		case EVENT_OBJECT_CREATE: type = WindowEventType::Created; break;
+		case EVENT_OBJECT_DESTROY: type = WindowEventType::Destroyed; break;
+		case EVENT_OBJECT_SHOW: type = WindowEventType::Shown; break;
+		case EVENT_OBJECT_HIDE: type = WindowEventType::Hidden; break;
+		case EVENT_SYSTEM_MINIMIZESTART: type = WindowEventType::Minimized; break;
+		case EVENT_SYSTEM_MINIMIZEEND: type = WindowEventType::Restored; break;
+		case EVENT_OBJECT_LOCATIONCHANGE: type = WindowEventType::LocationChanged; break;
+		case EVENT_OBJECT_NAMECHANGE: type = WindowEventType::NameChanged; break;
+		case EVENT_SYSTEM_FOREGROUND: type = WindowEventType::Foreground; break;
+		case EVENT_OBJECT_CLOAKED: type = WindowEventType::Cloaked; break;
+		case EVENT_OBJECT_UNCLOAKED: type = WindowEventType::Uncloaked; break;
+		default: return;
+	}
+
+	// Destroyed windows can no longer be queried, so let them through. All
+	// other events are only relevant if they concern a top-level window.
+	if (type != WindowEventType::Destroyed && GetAncestor(handle, GA_ROOT) != handle) {
+		return;
+	}
+
+	// Moving or resizing a window produces bursts of identical events of which
+	// only the latest state matters.
+	auto& pending = active_event_source->m_pending;
+	if (WindowEvent e = {type, handle}; pending.empty() || pending.back() != e) {
+		pending.emplace_back(e);
+	}
+}
+
+// There is no documented API that reports the current virtual desktop, but explorer.exe
+// keeps it in the registry, where changes to it can be waited for. Windows 11 and recent
+// builds of Windows 10 store it per user, older builds of Windows 10 per session.
+class RegistryDesktopSwitchSource : public DesktopSwitchSource {
+public:
+	RegistryDesktopSwitchSource() {
+		DWORD session_id = 0;
+		ProcessIdToSessionId(GetCurrentProcessId(), &session_id);
+
+		const string key_paths[] = {
+			"Software\\Microsoft\\Windows\\CurrentVersion\\Explorer\\VirtualDesktops",
+			format(
+				"Software\\Microsoft\\Windows\\CurrentVersion\\Explorer\\SessionInfo\\{}\\VirtualDesktops", session_id
+			),
+		};
+
+		for (const auto& path : key_paths) {
+			if (RegOpenKeyEx(HKEY_CURRENT_USER, path.c_str(), 0, KEY_READ | KEY_NOTIFY, &m_key) != ERROR_SUCCESS) {
+				m_key = nullptr;
+				continue;
+			}
+
+			if (read()) {
+				break;
+			}
+
+			RegCloseKey(m_key);
+			m_key = nullptr;
+		}
+
+		if (!m_key) {
+			throw runtime_error{"Current virtual desktop not found in the registry"};
+		}
+
+		// Auto-reset, like all handles the main loop waits for.
+		m_event = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+		if (!m_event) {
+			RegCloseKey(m_key);
+			throw runtime_error{format("Failed to create desktop switch event: {}", last_error_string())};
+		}
+
+		arm();
+	}
+
+	~RegistryDesktopSwitchSource() {
+		RegCloseKey(m_key);
+		CloseHandle(m_event);
+	}
+
+	RegistryDesktopSwitchSource(const RegistryDesktopSwitchSource& other) = delete;
+	RegistryDesktopSwitchSource& operator=(const RegistryDesktopSwitchSource& other) = delete;
+
+	HANDLE handle() const override { return m_event; }
+
+	// Notifications fire once and must be re-armed after each. Each call registers another one, so only after the
+	// previous one fired: otherwise, they pile up and a single switch signals the event several times.
+	void rearm() override { arm(); }
+
+	optional<GUID> current_desktop() override { return read(); }
+
+private:
+	void arm() {
+		if (LSTATUS res = RegNotifyChangeKeyValue(m_key, FALSE, REG_NOTIFY_CHANGE_LAST_SET, m_event, TRUE);
+			res != ERROR_SUCCESS) {
+			log_warning("Failed to watch the current virtual desktop: {}", error_string(res));
+		}
+	}
+
+	optional<GUID> read() const {
+		GUID id;
+		DWORD type = 0, n_bytes = sizeof(id);
+		if (RegQueryValueEx(m_key, "CurrentVirtualDesktop", nullptr, &type, (LPBYTE)&id, &n_bytes) != ERROR_SUCCESS ||
+			type != REG_BINARY || n_bytes != sizeof(id)) {
+			return {};
+		}
+
+		return id;
+	}
+
+	HKEY m_key = nullptr;
+	HANDLE m_event = nullptr;
+};
+
+class FindChangeNotificationSource : public DirectoryChangeSource {
+public:
+	FindChangeNotificationSource(const filesystem::path& dir) {
+		m_handle = FindFirstChangeNotificationW(
+			dir.c_str(), FALSE, FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE
+		);
+
+		if (m_handle == INVALID_HANDLE_VALUE) {
+			throw runtime_error{format("Failed to watch {}: {}", dir.string(), last_error_string())};
+		}
+	}
+
+	~FindChangeNotificationSource() { FindCloseChangeNotification(m_handle); }
+
+	FindChangeNotificationSource(const FindChangeNotificationSource& other) = delete;
+	FindChangeNotificationSource& operator=(const FindChangeNotificationSource& other) = delete;
+
+	HANDLE handle() const override { return m_handle; }
+
+	// The handle stays signalled until then.
+	void rearm() override {
+		if (!FindNextChangeNotification(m_handle)) {
+			log_warning("Failed to keep watching for file changes: {}", last_error_string());
+		}
+	}
+
+private:
+	HANDLE m_handle = INVALID_HANDLE_VALUE;
+};
+
+// Low-level keyboard hook. Windows calls it from the message loop of the thread that installed it, so it gets a
+// thread of its own, which does nothing else and therefore always answers in time.
+class LowLevelKeyboardHook : public KeyboardHook {
+public:
+	LowLevelKeyboardHook(function<bool(const KeyInput&)> on_key) : m_on_key{std::move(on_key)} {
+		promise<DWORD> thread_id;
+		m_thread = thread{[this, &thread_id]() { run(thread_id); }};
+		try {
+			m_thread_id = thread_id.get_future().get();
+		} catch (...) {
+			m_thread.join();
+			throw;
+		}
+	}
+
+	~LowLevelKeyboardHook() {
+		PostThreadMessage(m_thread_id, WM_QUIT, 0, 0);
+		m_thread.join();
+	}
+
+private:
+	void run(promise<DWORD>& thread_id) {
+		// Creates the thread's message queue, such that the destructor can post WM_QUIT to it.
+		MSG msg;
+		PeekMessage(&msg, nullptr, WM_USER, WM_USER, PM_NOREMOVE);
+
+		// Hook procedures get no context, hence the global. Only one hook exists at a time.
+		s_active = this;
+		HHOOK hook = SetWindowsHookEx(WH_KEYBOARD_LL, hook_proc, GetModuleHandle(nullptr), 0);
+		if (!hook) {
+			s_active = nullptr;
+			thread_id.set_exception(
+				make_exception_ptr(runtime_error{format("Failed to hook the keyboard: {}", last_error_string())})
+			);
+			return;
+		}
+
+		thread_id.set_value(GetCurrentThreadId());
+		while (GetMessage(&msg, nullptr, 0, 0) > 0) {
+			DispatchMessage(&msg);
+		}
+
+		UnhookWindowsHookEx(hook);
+		s_active = nullptr;
+	}
+
+	static LRESULT CALLBACK hook_proc(int code, WPARAM wparam, LPARAM lparam) {
+		auto* active = s_active.load();
+		if (code == HC_ACTION && active) {
+			const auto* info = (const KBDLLHOOKSTRUCT*)lparam;
+
+			// Only what the user types. In particular not what twm itself sends, e.g. to switch desktops.
+			if (!(info->flags & LLKHF_INJECTED)) {
+				KeyInput key = {.keycode = (UINT)info->vkCode, .release = (info->flags & LLKHF_UP) != 0};
+				if (active->m_on_key(key)) {
+					return 1;
+				}
+			}
+		}
+
+		return CallNextHookEx(nullptr, code, wparam, lparam);
+	}
+
+	static inline atomic<LowLevelKeyboardHook*> s_active = nullptr;
+
+	function<bool(const KeyInput&)> m_on_key;
+	thread m_thread;
+	DWORD m_thread_id = 0;
+};
+
+class WindowsPlatform : public Platform {
+public:
+	WindowsPlatform() {
+		// Required for IVirtualDesktopManager. Single-threaded, as befits the thread that owns twm's windows and
+		// pumps their messages, and as the shell expects of such threads.
+		CoInitialize(nullptr);
+
+		// Activating the manager is a round trip to the shell that takes tens of milliseconds, more so at login.
+		// It starts right away, such that it overlaps with the rest of startup instead of delaying the first update.
+		// The thread that does so joins the multithreaded apartment, from which the manager must be marshaled to
+		// be used in this thread's apartment. That apartment must outlive the thread for the manager to stay valid.
+		CoIncrementMTAUsage(&m_mta_usage);
+		m_desktop_manager_activation = async(launch::async, []() {
+			CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+			auto guard = ScopeGuard([]() { CoUninitialize(); });
+
+			IVirtualDesktopManager* desktop_manager = query_desktop_manager();
+			auto manager_guard = ScopeGuard([&]() { desktop_manager->Release(); });
+
+			IStream* stream;
+			HRESULT hr =
+				CoMarshalInterThreadInterfaceInStream(__uuidof(IVirtualDesktopManager), desktop_manager, &stream);
+			if (FAILED(hr)) {
+				throw runtime_error{"Failed to marshal virtual desktop manager."};
+			}
+
+			return stream;
+		});
+	}
+
+	vector<HWND> enumerate_windows() override {
+		vector<HWND> result;
+		EnumWindows(
+			[](__in HWND handle, __in LPARAM param) {
+				((vector<HWND>*)param)->emplace_back(handle);
+				return TRUE;
+			},
+			(LPARAM)&result
+		);
+
+		return result;
+	}
+
+	HWND foreground_window() override { return GetForegroundWindow(); }
+
+	bool is_window(HWND handle) override { return IsWindow(handle); }
+	bool is_window_visible(HWND handle) override { return IsWindowVisible(handle); }
+	bool is_window_minimized(HWND handle) override { return IsIconic(handle); }
+
+	// GetWindowText(Length) may send WM_GETTEXT(LENGTH) to the window, which blocks for as long as the window's
+	// thread does not respond. InternalGetWindowText instead reads the text that the system keeps for the window.
+	string window_text(HWND handle) override {
+		wstring wname(256, L'\0');
+		while (true) {
+			int length = InternalGetWindowText(handle, wname.data(), (int)wname.size());
+			if (length <= 0) {
+				SetLastError(0);
+				return "";
+			}
+
+			// Possibly truncated
+			if (length + 1 >= (int)wname.size()) {
+				wname.resize(wname.size() * 2);
+				continue;
+			}
+
+			wname.resize(length);
+			return utf16_to_utf8(wname);
+		}
+	}
+
+	bool window_has_text(HWND handle) override {
+		wchar_t first[2];
+		bool result = InternalGetWindowText(handle, first, 2) > 0;
+		SetLastError(0);
+		return result;
+	}
+
+	Rect window_rect(HWND handle) override {
+		if (RECT r; GetWindowRect(handle, &r) == 0) {
+			throw runtime_error{format("Could not obtain rect: {}", last_error_string())};
+		} else {
+			return {r};
+		}
+	}
+
+	Rect window_frame_bounds(HWND handle) override {
+		if (RECT r; HRESULT result = DwmGetWindowAttribute(handle, DWMWA_EXTENDED_FRAME_BOUNDS, &r, sizeof(r)) != S_OK) {
+			static bool warned = false;
+			if (!warned) {
+				log_warning(
+					"DwmGetWindowAttribute(DWMWA_EXTENDED_FRAME_BOUNDS) failed: {}. Falling back to GetWindowRect.",
+					error_string(result)
+				);
+				warned = true;
+			}
+
+			return window_rect(handle);
+		} else {
+			return {r};
+		}
+	}
+
+	WindowFrameState window_frame_state(HWND handle) override {
+		return {
+			.style = GetWindowLongPtr(handle, GWL_STYLE),
+			.ex_style = GetWindowLongPtr(handle, GWL_EXSTYLE),
+			.dpi = GetDpiForWindow(handle),
+			.monitor = MonitorFromWindow(handle, MONITOR_DEFAULTTONEAREST),
+		};
+	}
+
+	bool set_window_rect(HWND handle, const Rect& r) override {
+		if (SetWindowPos(
+				handle,
+				nullptr,
+				(LONG)r.top_left.x,
+				(LONG)r.top_left.y,
+				(LONG)r.size().x,
+				(LONG)r.size().y,
+				SWP_NOACTIVATE | SWP_NOOWNERZORDER | SWP_NOZORDER
+			) == 0) {
+			log_warning("Could not set rect: {}", last_error_string());
+			return false;
+		}
+
+		return true;
+	}
+
+	vector<HWND> set_window_rects(const vector<pair<HWND, Rect>>& rects) override {
+		vector<HWND> failed;
+		if (HDWP batch = BeginDeferWindowPos((int)rects.size())) {
+			for (const auto& [handle, r] : rects) {
+				batch = DeferWindowPos(
+					batch,
+					handle,
+					nullptr,
+					(LONG)r.top_left.x,
+					(LONG)r.top_left.y,
+					(LONG)r.size().x,
+					(LONG)r.size().y,
+					SWP_NOACTIVATE | SWP_NOOWNERZORDER | SWP_NOZORDER
+				);
+
+				// On failure, Windows has already discarded the batch.
+				if (!batch) {
+					break;
+				}
+			}
+
+			if (batch && EndDeferWindowPos(batch)) {
+				return failed;
+			}
+		}
+
+		// The batch is all-or-nothing. Fall back to moving the windows one by one
+		// to get the others into place and to find out which ones are at fault.
+		log_debug("Deferred window positioning failed: {}. Moving windows one by one.", last_error_string());
+		for (const auto& [handle, r] : rects) {
+			if (!set_window_rect(handle, r)) {
+				failed.emplace_back(handle);
+			}
+		}
+
+		return failed;
+	}
+
+	// With SMTO_ABORTIFHUNG, fails right away if the window is hung already, see IsHungAppWindow.
+	bool ping_window(HWND handle) override {
+		return SendMessageTimeout(handle, WM_NULL, 0, 0, SMTO_ABORTIFHUNG, INFINITE, nullptr) != 0;
+	}
+
+	bool focus_window(HWND handle) override { return SetForegroundWindow(handle) != 0; }
+	bool close_window(HWND handle) override { return PostMessage(handle, WM_CLOSE, 0, 0) != 0; }
+
+	bool terminate_process(HWND handle) override {
+		if (DWORD process_id = 0; GetWindowThreadProcessId(handle, &process_id) == 0 || process_id == 0) {
+			return false;
+		} else {
+			HANDLE process = OpenProcess(PROCESS_TERMINATE, 0, process_id);
+			return process && TerminateProcess(process, 0) != 0;
+		}
+	}
+
+	void set_window_attribute(HWND handle, WindowAttribute attribute, uint32_t value) override {
+		DwmSetWindowAttribute(handle, (DWORD)attribute, &value, sizeof(value));
+	}
+
+	void set_system_dropshadow(bool enabled) override {
+		if (!SystemParametersInfo(SPI_SETDROPSHADOW, 0, (PVOID)enabled, SPIF_SENDCHANGE)) {
+			log_warning("Could not set dropshadow: {}", last_error_string());
+		}
+	}
+
+	Rect primary_work_area() override {
+		if (RECT r; SystemParametersInfo(SPI_GETWORKAREA, 0, &r, 0) == 0) {
+			throw runtime_error{format("Could not obtain work area: {}", last_error_string())};
+		} else {
+			return {r};
+		}
+	}
+
+	optional<GUID> window_desktop_id(HWND handle) override {
+		if (
+			GUID desktop_id;
+			desktop_manager()->GetWindowDesktopId(handle, &desktop_id) != S_OK || equal_to<GUID>{}(desktop_id, GUID{})
+		) {
+			return {};
+		} else {
+			return desktop_id;
+		}
+	}
+
+	bool is_window_on_current_desktop(HWND handle) override {
+		BOOL is_current_desktop = 0;
+		HRESULT r = desktop_manager()->IsWindowOnCurrentVirtualDesktop(handle, &is_current_desktop);
+		return r == S_OK && is_current_desktop != 0;
+	}
+
+	bool move_window_to_desktop(HWND handle, const GUID& desktop_id) override {
+		if (HRESULT res = desktop_manager()->MoveWindowToDesktop(handle, desktop_id) != S_OK) {
+			log_warning("Failed to move window to desktop: {}", error_string(res));
+			return false;
+		} else {
+			return true;
+		}
+	}
+
+	VirtualDesktops virtual_desktops() override {
+		VirtualDesktops result;
+		GUID current_id = {};
+		{
+			IVirtualDesktop* current = nullptr;
+			if (FAILED(desktop_manager_internal()->GetCurrentDesktop(&current))) {
+				throw runtime_error{"Failed to get the current virtual desktop"};
+			}
+
+			auto guard = ScopeGuard([&]() { current->Release(); });
+			current->GetId(&current_id);
+		}
+
+		for_each_desktop([&](IVirtualDesktop* desktop, const GUID& id) {
+			if (equal_to<GUID>{}(id, current_id)) {
+				result.current = result.ids.size();
+			}
+
+			result.ids.emplace_back(id);
+			return false;
+		});
+
+		return result;
+	}
+
+	void switch_to_desktop(const GUID& desktop_id) override {
+		bool found = for_each_desktop([&](IVirtualDesktop* desktop, const GUID& id) {
+			if (!equal_to<GUID>{}(id, desktop_id)) {
+				return false;
+			}
+
+			if (HRESULT res = desktop_manager_internal()->SwitchDesktop(desktop); FAILED(res)) {
+				throw runtime_error{format("SwitchDesktop failed: {}", error_string(res))};
+			}
+
+			return true;
+		});
+
+		if (!found) {
+			throw runtime_error{"Virtual desktop not found"};
+		}
+	}
+
+	void register_hotkey(int id, UINT modifiers, UINT keycode) override {
+		if (RegisterHotKey(nullptr, id, modifiers, keycode) == 0) {
+			throw runtime_error{last_error_string()};
+		}
+	}
+
+	void unregister_hotkey(int id) override { UnregisterHotKey(nullptr, id); }
+
+	UINT held_modifiers() override {
+		UINT result = 0;
+		if (GetAsyncKeyState(VK_CONTROL) & 0x8000) {
+			result |= MOD_CONTROL;
+		}
+
+		if (GetAsyncKeyState(VK_MENU) & 0x8000) {
+			result |= MOD_ALT;
+		}
+
+		if (GetAsyncKeyState(VK_SHIFT) & 0x8000) {
+			result |= MOD_SHIFT;
+		}
+
+		if (GetAsyncKeyState(VK_LWIN) & 0x8000) {
+			result |= MOD_WIN;
+		}
+
+		return result;
+	}
+
+	void send_input(const vector<KeyInput>& inputs) override {
+		vector<INPUT> raw_inputs;
+		for (const auto& input : inputs) {
+			INPUT in = {};
+			in.type = INPUT_KEYBOARD;
+			in.ki.wVk = (WORD)input.keycode;
+			in.ki.dwFlags = input.release ? KEYEVENTF_KEYUP : 0;
+			raw_inputs.emplace_back(in);
+		}
+
+		if (UINT n_sent = SendInput((UINT)raw_inputs.size(), raw_inputs.data(), sizeof(INPUT)); n_sent != raw_inputs.size()) {
+			throw runtime_error{format("SendInput failed: {}", last_error_string())};
+		}
+	}
+
+	unique_ptr<WindowEventSource> create_window_event_source() override { return make_unique<WinEventHookSource>(); }
+
+	unique_ptr<KeyboardHook> create_keyboard_hook(function<bool(const KeyInput&)> on_key) override {
+		return make_unique<LowLevelKeyboardHook>(std::move(on_key));
+	}
+
+	unique_ptr<DesktopSwitchSource> create_desktop_switch_source() override {
+		return make_unique<RegistryDesktopSwitchSource>();
+	}
+
+	unique_ptr<DirectoryChangeSource> create_directory_change_source(const filesystem::path& dir) override {
+		return make_unique<FindChangeNotificationSource>(dir);
+	}
+
+	HANDLE create_event() override {
+		HANDLE handle = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+		if (!handle) {
+			throw runtime_error{format("Failed to create event: {}", last_error_string())};
+		}
+
+		return handle;
+	}
+
+	void set_event(HANDLE handle) override { SetEvent(handle); }
+	void close_event(HANDLE handle) override { CloseHandle(handle); }
+
+	optional<size_t> wait(const vector<HANDLE>& handles, optional<clock::duration> timeout) override {
+		// One slot of the wait array is implicitly taken by the message queue.
+		if (handles.size() >= MAXIMUM_WAIT_OBJECTS - 1) {
+			throw runtime_error{"Too many handles to wait for"};
+		}
+
+		DWORD timeout_ms = INFINITE;
+		if (timeout) {
+			// Round up. Waking up early would only lead to another, spurious wakeup.
+			auto ms = chrono::ceil<chrono::milliseconds>(std::max(*timeout, clock::duration::zero())).count();
+			timeout_ms = (DWORD)std::min<decltype(ms)>(ms, INFINITE - 1);
+		}
+
+		DWORD result = MsgWaitForMultipleObjectsEx(
+			(DWORD)handles.size(), handles.data(), timeout_ms, QS_ALLINPUT, MWMO_INPUTAVAILABLE
+		);
+
+		if (result == WAIT_FAILED) {
+			throw runtime_error{format("MsgWaitForMultipleObjectsEx failed: {}", last_error_string())};
+		}
+
+		if (result >= WAIT_OBJECT_0 && result < WAIT_OBJECT_0 + handles.size()) {
+			return result - WAIT_OBJECT_0;
+		}
+
+		return {};
+	}
+
+	bool next_message(Message& message) override {
+		MSG msg = {};
+		while (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE) != 0) {
+			if (msg.hwnd != nullptr) {
+				TranslateMessage(&msg);
+				DispatchMessage(&msg);
+				continue;
+			}
+
+			// The message time stems from GetTickCount() and is therefore coarse (~16 ms), but
+			// it is the only timestamp that also covers the time the message spent in the queue.
+			message = {
+				.raw_id = msg.message,
+				.posted = clock::now() - chrono::milliseconds{GetTickCount() - msg.time},
+			};
+
+			switch (msg.message) {
+				case WM_HOTKEY: {
+					message.type = MessageType::Hotkey;
+					message.hotkey_id = (int)msg.wParam;
+				} break;
+				case WM_DESTROY:
+				case WM_CLOSE:
+				case WM_QUIT: message.type = MessageType::Quit; break;
+				default: message.type = MessageType::Other; break;
+			}
+
+			return true;
+		}
+
+		return false;
+	}
+
+	bool is_autostart_enabled() override {
+		HKEY key;
+		if (HRESULT res = RegOpenKeyEx(HKEY_CURRENT_USER, "Software\\Microsoft\\Windows\\CurrentVersion\\Run", 0, KEY_READ, &key) != ERROR_SUCCESS) {
+			log_warning("Could not open registry key for reading: {}", error_string(res));
+			return false;
+		}
+
+		auto guard = ScopeGuard([&]() { RegCloseKey(key); });
+
+		wchar_t registry_path[MAX_PATH];
+		DWORD n_bytes = sizeof(registry_path);
+		if (RegQueryValueExW(key, L"twm", 0, nullptr, (LPBYTE)registry_path, &n_bytes) != ERROR_SUCCESS) {
+			return false;
+		}
+
+		wchar_t executable_path[MAX_PATH];
+		DWORD len = GetModuleFileNameW(nullptr, executable_path, MAX_PATH);
+		if (len == 0 || len == MAX_PATH) {
+			log_warning("Could not get module file name");
+			return false;
+		}
+
+		return !wcscmp(registry_path, executable_path);
+	}
+
+	bool set_autostart_enabled(bool value) override {
+		HKEY key;
+		if (HRESULT res = RegOpenKeyEx(HKEY_CURRENT_USER, "Software\\Microsoft\\Windows\\CurrentVersion\\Run", 0, KEY_WRITE, &key) != ERROR_SUCCESS) {
+			log_warning("Could not open registry key for writing: {}", error_string(res));
+			return false;
+		}
+
+		auto guard = ScopeGuard([&]() { RegCloseKey(key); });
+
+		if (value) {
+			log_debug("Enabling autostart");
+
+			wchar_t path[MAX_PATH];
+			DWORD len = GetModuleFileNameW(nullptr, path, MAX_PATH);
+			if (len == 0 || len == MAX_PATH) {
+				log_warning("Could not get module file name");
+				return false;
+			}
+
+			if (HRESULT res = RegSetValueExW(key, L"twm", 0, REG_SZ, (const BYTE*)path, sizeof(wchar_t) * (len + 1)) != ERROR_SUCCESS) {
+				log_warning("Could not set registry value: {}", error_string(res));
+				return false;
+			}
+		} else {
+			log_debug("Disabling autostart");
+
+			if (HRESULT res = RegDeleteValueW(key, L"twm") != ERROR_SUCCESS) {
+				log_warning("Could not delete registry value: {}", error_string(res));
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+private:
+	static IServiceProvider* query_immersive_shell() {
+		const CLSID CLSID_ImmersiveShell = {
+			0xC2F03A33,
+			0x21F5,
+			0x47FA,
+			{0xB4, 0xBB, 0x15, 0x63, 0x62, 0xA2, 0xF2, 0x39}
+		};
+
+		IServiceProvider* service_provider = NULL;
+
+		HRESULT hr = CoCreateInstance(
+			CLSID_ImmersiveShell,
+			NULL,
+			CLSCTX_LOCAL_SERVER,
+			__uuidof(IServiceProvider),
+			(PVOID*)&service_provider
+		);
+
+		if (FAILED(hr)) {
+			throw runtime_error{format("Failed to get immersive shell service provider: {}", std::to_string(hr))};
+		}
+
+		return service_provider;
+	}
+
+	static IVirtualDesktopManager* query_desktop_manager() {
+		IServiceProvider* service_provider = query_immersive_shell();
+		auto guard = ScopeGuard([&]() { service_provider->Release(); });
+
+		IVirtualDesktopManager* desktop_manager;
+		HRESULT hr = service_provider->QueryService(__uuidof(IVirtualDesktopManager), &desktop_manager);
+
+		if (FAILED(hr)) {
+			throw runtime_error{"Failed to get virtual desktop manager."};
+		}
+
+		SetLastError(0);
+		return desktop_manager;
+	}
+
+	IVirtualDesktopManagerInternal* desktop_manager_internal() {
+		if (m_desktop_manager_internal) {
+			return m_desktop_manager_internal;
+		}
+
+		// Querying again would fail again, and take a COM round trip each time.
+		if (m_desktop_manager_internal_unavailable) {
+			throw runtime_error{"No known desktop manager"};
+		}
+
+		m_desktop_manager_internal_unavailable = true;
+
+		const CLSID CLSID_VirtualDesktopManagerInternal = {
+			0xC5E0CDCA,
+			0x7B6E,
+			0x41B2,
+			{0x9F, 0xC4, 0xD9, 0x39, 0x75, 0xCC, 0x46, 0x7B}
+		};
+
+		IServiceProvider* service_provider = query_immersive_shell();
+		auto guard = ScopeGuard([&]() { service_provider->Release(); });
+
+		for (const auto& version : DESKTOP_MANAGER_VERSIONS) {
+			void* manager = nullptr;
+			HRESULT hr = service_provider->QueryService(CLSID_VirtualDesktopManagerInternal, version.manager, &manager);
+			if (SUCCEEDED(hr)) {
+				log_debug("Using the desktop manager of Windows {}", version.windows);
+				m_desktop_manager_internal = (IVirtualDesktopManagerInternal*)manager;
+				m_virtual_desktop_iid = version.desktop;
+				m_desktop_manager_internal_unavailable = false;
+				return m_desktop_manager_internal;
+			}
+		}
+
+		throw runtime_error{"No known desktop manager"};
+	}
+
+	// Calls `fn` with each desktop and its ID, in the order of the task view, until it returns true. Returns whether
+	// it did.
+	bool for_each_desktop(const function<bool(IVirtualDesktop*, const GUID&)>& fn) {
+		IObjectArray* desktops = nullptr;
+		if (FAILED(desktop_manager_internal()->GetDesktops(&desktops))) {
+			throw runtime_error{"Failed to get the virtual desktops"};
+		}
+
+		auto guard = ScopeGuard([&]() { desktops->Release(); });
+
+		UINT n_desktops = 0;
+		desktops->GetCount(&n_desktops);
+		for (UINT i = 0; i < n_desktops; ++i) {
+			IVirtualDesktop* desktop = nullptr;
+			if (FAILED(desktops->GetAt(i, m_virtual_desktop_iid, (void**)&desktop))) {
+				continue;
+			}
+
+			auto desktop_guard = ScopeGuard([&]() { desktop->Release(); });
+			if (GUID id; SUCCEEDED(desktop->GetId(&id)) && fn(desktop, id)) {
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	IVirtualDesktopManager* desktop_manager() {
+		if (!m_desktop_manager) {
+			// Should the activation have failed, its future is gone and later calls try again.
+			if (m_desktop_manager_activation.valid()) {
+				// Releases the stream, whether or not it succeeds.
+				IStream* stream = m_desktop_manager_activation.get();
+				IVirtualDesktopManager* desktop_manager;
+				HRESULT hr =
+					CoGetInterfaceAndReleaseStream(stream, __uuidof(IVirtualDesktopManager), (void**)&desktop_manager);
+				if (FAILED(hr)) {
+					throw runtime_error{"Failed to unmarshal virtual desktop manager."};
+				}
+
+				m_desktop_manager = desktop_manager;
+			} else {
+				m_desktop_manager = query_desktop_manager();
+			}
+		}
+
+		return m_desktop_manager;
+	}
+
+	IVirtualDesktopManager* m_desktop_manager = nullptr;
+	// Marshaled from the thread that activated the manager
+	future<IStream*> m_desktop_manager_activation;
+	CO_MTA_USAGE_COOKIE m_mta_usage = nullptr;
+
+	IVirtualDesktopManagerInternal* m_desktop_manager_internal = nullptr;
+	IID m_virtual_desktop_iid = {};
+	bool m_desktop_manager_internal_unavailable = false;
+};
+
+unique_ptr<Platform> create_windows_platform() { return make_unique<WindowsPlatform>(); }
+
+} // namespace twm
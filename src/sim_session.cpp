@@ -0,0 +1,113 @@
+// This file was developed by Thomas Müller <thomas94@gmx.net>.
+// It is published under the GPU GPLv3 license; see LICENSE.txt for details.
+
+#include <twm/common.h>
+#include <twm/config.h>
+#include <twm/desktop.h>
+#include <twm/math.h>
+#include <twm/sim_session.h>
+
+#include <cmath>
+#include <format>
+#include <memory>
+#include <random>
+#include <string>
+
+using namespace std;
+
+namespace twm {
+
+SimulatedSession start_simulated_session(size_t n_windows, size_t n_desktops) {
+	Desktop::all().clear();
+	Desktop::current_id() = {};
+	Desktop::tracks_current_id() = false;
+	cfg.hotkeys.clear();
+	cfg = {};
+
+	SimulatedSession session;
+	auto platform = make_unique<SimulatedPlatform>();
+	session.sim = platform.get();
+	set_platform(std::move(platform));
+
+	auto* sim = session.sim;
+	vector<GUID> desktop_ids = {sim->current_desktop()};
+	while (desktop_ids.size() < n_desktops) {
+		desktop_ids.emplace_back(sim->create_desktop());
+	}
+
+	mt19937 rng{(uint32_t)n_windows};
+	uniform_real_distribution<float> jitter{0.0f, 0.3f};
+
+	size_t n_cols = (size_t)ceil(sqrt((double)n_windows));
+	Vec2 cell = Vec2{1920.0f, 1032.0f} / (float)n_cols;
+
+	for (size_t i = 0; i < n_windows; ++i) {
+		Vec2 top_left = Vec2{(float)(i % n_cols), (float)(i / n_cols)} * cell;
+		Vec2 top_left_jitter = cell * jitter(rng), bottom_right_jitter = cell * (1.0f - jitter(rng));
+		Rect r = {
+			{round(top_left.x + top_left_jitter.x),     round(top_left.y + top_left_jitter.y)    },
+			{round(top_left.x + bottom_right_jitter.x), round(top_left.y + bottom_right_jitter.y)},
+		};
+
+		session.handles.emplace_back(sim->create_window(format("Window {}", i), r, desktop_ids[i % n_desktops]));
+	}
+
+	if (!session.handles.empty()) {
+		sim->activate_window(session.handles.front());
+	}
+
+	Desktop::update_all();
+	return session;
+}
+
+namespace {
+
+const char* ACTIONS[] = {"focus window left", "swap window right", "move_to_desktop window left", "close window"};
+const string KEYS = "abcdefghijklmnopqrstuvwxyz0123456789";
+
+} // namespace
+
+vector<Binding> make_hotkey_bindings(size_t n) {
+	const char* modifiers[] = {"alt", "ctrl", "shift", "win"};
+
+	vector<Binding> bindings;
+	for (size_t mask = 1; mask < 16 && bindings.size() < n; ++mask) {
+		vector<string> mods;
+		for (size_t i = 0; i < 4; ++i) {
+			if (mask & (1 << i)) {
+				mods.emplace_back(modifiers[i]);
+			}
+		}
+
+		for (size_t i = 0; i < KEYS.size() && bindings.size() < n; ++i) {
+			bindings.push_back({format("{}-{}", join(mods, "-"), KEYS[i]), ACTIONS[bindings.size() % size(ACTIONS)]});
+		}
+	}
+
+	return bindings;
+}
+
+KeySequenceScenario make_key_sequences(size_t n) {
+	KeySequenceScenario result;
+	for (size_t i = 0; i < n; ++i) {
+		size_t n_keys = KEYS.size();
+		char a = KEYS[i % n_keys], b = KEYS[i / n_keys % n_keys], c = KEYS[i / n_keys / n_keys % n_keys];
+		result.bindings.push_back({format("alt-{} {} {}", a, b, c), ACTIONS[i % size(ACTIONS)]});
+
+		auto vk = [](char key) { return (UINT)toupper(key); };
+		result.presses.push_back({
+			{VK_LMENU, false},
+			{vk(a),    false},
+			{vk(a),    true },
+			{VK_LMENU, true },
+			{vk(b),    false},
+			{vk(b),    true },
+			{vk(c),    false},
+			{vk(c),    true },
+		});
+	}
+
+	return result;
+}
+
+} // namespace twm
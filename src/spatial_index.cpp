@@ -0,0 +1,174 @@
+// This file was developed by Thomas Müller <thomas94@gmx.net>.
+// It is published under the GPU GPLv3 license; see LICENSE.txt for details.
+
+#include <twm/common.h>
+#include <twm/spatial_index.h>
+
+#include <algorithm>
+#include <limits>
+
+using namespace std;
+
+namespace twm {
+
+// Accumulates the best candidate. The most recently interacted window wins;
+// ties are broken by distance and, finally, by handle such that the result
+// never depends on the order in which candidates are visited.
+struct AdjacentCandidate {
+	HWND handle = nullptr;
+	float distance = numeric_limits<float>::infinity();
+	clock::time_point last_interacted = {};
+
+	void consider(HWND h, float d, clock::time_point t) {
+		if (!handle || t > last_interacted ||
+			(t == last_interacted && (d < distance || (d == distance && less<HWND>{}(h, handle))))) {
+			handle = h;
+			distance = d;
+			last_interacted = t;
+		}
+	}
+};
+
+// Whether a window centered at `key` along the axis lies in direction `dir` of a window centered at `center`.
+bool is_on_correct_side(float center, float key, Direction dir) {
+	float in_axis_dist = center - key;
+	return abs(in_axis_dist) > SpatialIndex::CLOSENESS_TOLERANCE &&
+		(in_axis_dist > 0) == (dir == Direction::Up || dir == Direction::Left);
+}
+
+bool SpatialIndex::entry_less(const Entry& a, const Entry& b) {
+	return a.key < b.key || (a.key == b.key && less<HWND>{}(a.handle, b.handle));
+}
+
+void SpatialIndex::set(HWND handle, const Rect& rect) {
+	if (auto it = m_rects.find(handle); it != m_rects.end()) {
+		if (it->second == rect) {
+			return;
+		}
+
+		erase(handle);
+	}
+
+	m_rects.insert({handle, rect});
+
+	for (size_t axis = 0; axis < 2; ++axis) {
+		auto& entries = m_entries[axis];
+		Entry entry = {rect.center()[axis], handle, rect};
+		entries.insert(upper_bound(entries.begin(), entries.end(), entry, entry_less), entry);
+	}
+}
+
+void SpatialIndex::erase(HWND handle) {
+	auto it = m_rects.find(handle);
+	if (it == m_rects.end()) {
+		return;
+	}
+
+	for (size_t axis = 0; axis < 2; ++axis) {
+		auto& entries = m_entries[axis];
+		Entry entry = {it->second.center()[axis], handle, it->second};
+		if (auto eit = lower_bound(entries.begin(), entries.end(), entry, entry_less);
+			eit != entries.end() && eit->handle == handle) {
+			entries.erase(eit);
+		}
+	}
+
+	m_rects.erase(it);
+}
+
+void SpatialIndex::clear() {
+	m_rects.clear();
+	m_entries[0].clear();
+	m_entries[1].clear();
+}
+
+HWND SpatialIndex::adjacent(HWND handle, Direction dir, const RecencyFn& recency) const {
+	auto source_it = m_rects.find(handle);
+	if (source_it == m_rects.end()) {
+		return nullptr;
+	}
+
+	const Rect& source = source_it->second;
+	size_t axis = axis_of(dir);
+	float center = source.center()[axis];
+	const auto& entries = m_entries[axis];
+
+	// The distance along the axis is a lower bound of `distance_with_axis_preference`. Visiting the windows
+	// in order of increasing distance along the axis therefore allows stopping as soon as it reaches `bound`.
+	// `bound` is re-evaluated after every visit, since the visits tighten it.
+	auto walk = [&](const auto& bound, const auto& visit) {
+		if (dir == Direction::Right || dir == Direction::Down) {
+			auto it = partition_point(entries.begin(), entries.end(), [&](const Entry& e) {
+				return !is_on_correct_side(center, e.key, dir);
+			});
+
+			for (; it != entries.end() && abs(center - it->key) < bound(); ++it) {
+				visit(*it);
+			}
+		} else {
+			auto it = partition_point(entries.begin(), entries.end(), [&](const Entry& e) {
+				return is_on_correct_side(center, e.key, dir);
+			});
+
+			while (it != entries.begin() && abs(center - prev(it)->key) < bound()) {
+				visit(*--it);
+			}
+		}
+	};
+
+	// First pass: find the closest distance. Second pass: among all windows within tolerance of
+	// that distance, pick the most recently interacted one.
+	float best_distance = numeric_limits<float>::infinity();
+	walk(
+		[&]() { return best_distance; },
+		[&](const Entry& e) {
+			if (e.handle != handle) {
+				best_distance = std::min(best_distance, source.distance_with_axis_preference(axis, e.rect));
+			}
+		}
+	);
+
+	AdjacentCandidate best;
+	walk(
+		[&]() { return best_distance + CLOSENESS_TOLERANCE; },
+		[&](const Entry& e) {
+			float dist = source.distance_with_axis_preference(axis, e.rect);
+			if (e.handle != handle && dist < best_distance + CLOSENESS_TOLERANCE) {
+				best.consider(e.handle, dist, recency(e.handle));
+			}
+		}
+	);
+
+	return best.handle;
+}
+
+HWND SpatialIndex::adjacent_brute_force(HWND handle, Direction dir, const RecencyFn& recency) const {
+	auto source_it = m_rects.find(handle);
+	if (source_it == m_rects.end()) {
+		return nullptr;
+	}
+
+	const Rect& source = source_it->second;
+	size_t axis = axis_of(dir);
+	float center = source.center()[axis];
+
+	float best_distance = numeric_limits<float>::infinity();
+	for (const auto& [h, rect] : m_rects) {
+		if (h != handle && is_on_correct_side(center, rect.center()[axis], dir)) {
+			best_distance = std::min(best_distance, source.distance_with_axis_preference(axis, rect));
+		}
+	}
+
+	AdjacentCandidate best;
+	for (const auto& [h, rect] : m_rects) {
+		float dist = source.distance_with_axis_preference(axis, rect);
+		if (h != handle && is_on_correct_side(center, rect.center()[axis], dir) &&
+			dist < best_distance + CLOSENESS_TOLERANCE) {
+			best.consider(h, dist, recency(h));
+		}
+	}
+
+	return best.handle;
+}
+
+} // namespace twm
@@ -0,0 +1,851 @@
+// This file was developed by Thomas Müller <thomas94@gmx.net>.
+// It is published under the GPU GPLv3 license; see LICENSE.txt for details.
+
+// Tests of twm's logic against the simulated platform. Many compare an optimized code path against the simpler one
+// that it replaces, or against what the simulation says is true. Prints each failed check and exits with a non-zero
+// code if there were any, such that ctest notices.
+//
+// Usage: twm_test [--filter <substring>]
+
+#include <twm/action.h>
+#include <twm/app.h>
+#include <twm/common.h>
+#include <twm/config.h>
+#include <twm/desktop.h>
+#include <twm/hotkey.h>
+#include <twm/input.h>
+#include <twm/keys.h>
+#include <twm/logging.h>
+#include <twm/loop.h>
+#include <twm/platform.h>
+#include <twm/platform_sim.h>
+#include <twm/sim_session.h>
+#include <twm/spatial_index.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <random>
+#include <source_location>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+using namespace std;
+using namespace twm;
+
+namespace {
+
+string filter;
+size_t n_failed_checks = 0;
+
+// Unlike assert, keeps going, such that one run reports all failures.
+bool check(bool ok, string_view what, source_location location = source_location::current()) {
+	if (!ok) {
+		cerr << format("  {}:{}: check failed: {}\n", location.file_name(), location.line(), what);
+		++n_failed_checks;
+	}
+
+	return ok;
+}
+
+SimulatedPlatform* sim = nullptr;
+
+// Starts over, see start_simulated_session.
+vector<HWND> reset(size_t n_windows, size_t n_desktops = 1) {
+	auto session = start_simulated_session(n_windows, n_desktops);
+	sim = session.sim;
+	return session.handles;
+}
+
+const Direction DIRECTIONS[] = {Direction::Up, Direction::Down, Direction::Left, Direction::Right};
+
+// The spatial index must find the same neighbors as the exhaustive search that it replaces.
+void test_spatial_index() {
+	for (size_t n_windows : {10, 100, 1000}) {
+		auto handles = reset(n_windows);
+
+		SpatialIndex index;
+		unordered_map<HWND, clock::time_point> recency_map;
+
+		// Few distinct times, such that ties between equally close windows are common.
+		mt19937 rng{(uint32_t)n_windows};
+		for (HWND h : handles) {
+			index.set(h, sim->window_frame_bounds(h));
+			recency_map[h] = clock::time_point{chrono::seconds{rng() % 4}};
+		}
+
+		auto recency = [&](HWND h) { return recency_map.at(h); };
+		for (HWND h : handles) {
+			for (Direction dir : DIRECTIONS) {
+				check(index.adjacent(h, dir, recency) == index.adjacent_brute_force(h, dir, recency), "same neighbor");
+			}
+		}
+	}
+}
+
+// The deferred-positioning batches that the simulation recorded after the first `n_seen`, which then counts them, too
+vector<vector<HWND>> new_position_batches(size_t& n_seen) {
+	auto batches = sim->position_batches();
+	vector<vector<HWND>> result{batches.begin() + n_seen, batches.end()};
+	n_seen = batches.size();
+	return result;
+}
+
+// Moving several windows at once must commit a single deferred-positioning batch that holds each window that
+// actually moves once, such that no intermediate state is ever shown.
+void test_geometry_transaction() {
+	auto handles = reset(9);
+
+	vector<Window*> windows;
+	for (size_t i = 0; i < 3; ++i) {
+		windows.emplace_back(Window::get(handles[i]));
+	}
+
+	if (!check(all_of(windows.begin(), windows.end(), [](Window* w) { return w; }), "windows managed")) {
+		return;
+	}
+
+	auto moved_by = [](const Rect& r) { return r + Rect{Vec2{10.0f}, Vec2{10.0f}}; };
+	size_t n_batches = sim->position_batches().size();
+
+	vector<pair<Window*, Rect>> targets;
+	for (auto* w : windows) {
+		targets.emplace_back(w, moved_by(w->rect()));
+	}
+
+	check(Window::set_rects(targets), "windows moved");
+	check(
+		new_position_batches(n_batches) == vector<vector<HWND>>{{handles[0], handles[1], handles[2]}},
+		"one batch of all windows"
+	);
+	for (const auto& [w, r] : targets) {
+		check(w->rect() == r && sim->window_frame_bounds(w->handle()) == r, "window at its target");
+	}
+
+	// Windows that are already where they should be are left out, and without any, there is no batch at all.
+	Window::set_rects({
+		{windows[0], moved_by(windows[0]->rect())},
+		{windows[1], windows[1]->rect()          },
+		{windows[2], windows[2]->rect()          },
+	});
+	check(new_position_batches(n_batches) == vector<vector<HWND>>{{handles[0]}}, "one batch of the moved window");
+
+	Window::set_rects({
+		{windows[0], windows[0]->rect()},
+	});
+	check(new_position_batches(n_batches).empty(), "no batch without moves");
+
+	// Staging a window again replaces its earlier move.
+	Rect target = moved_by(moved_by(windows[0]->rect()));
+	GeometryTransaction transaction;
+	transaction.stage(handles[0], moved_by(windows[0]->rect()));
+	transaction.stage(handles[0], target);
+	check(transaction.commit().empty(), "window moved");
+	check(new_position_batches(n_batches) == vector<vector<HWND>>{{handles[0]}}, "one batch with the window once");
+	check(sim->window_frame_bounds(handles[0]) == target, "window at its last staged target");
+
+	// Swapping two windows moves both at once.
+	auto [focused, adjacent] = Window::focused_and_adjacent(Direction::Right);
+	if (!check(adjacent, "window to the right")) {
+		return;
+	}
+
+	vector<HWND> swapped = {focused->handle(), adjacent->handle()};
+	invoke_action(parse_command("swap window right"));
+	check(new_position_batches(n_batches) == vector<vector<HWND>>{swapped}, "one batch of both swapped windows");
+}
+
+// Changes in the order of the windows' handles, such that they compare independently of the order of the layout.
+BspTree::Changes sorted(BspTree::Changes changes) {
+	sort(changes.begin(), changes.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+	return changes;
+}
+
+// Splits, removals, and resizes of the tiling layout must result in the expected tiles, and must only report the
+// windows whose tiles changed.
+void test_bsp() {
+	HWND a = (HWND)1, b = (HWND)2, c = (HWND)3, d = (HWND)4, e = (HWND)5;
+	auto rect = [](float left, float top, float right, float bottom) { return Rect{{left, top}, {right, bottom}}; };
+
+	BspTree tree{rect(0, 0, 1000, 600)};
+	check(sorted(tree.insert(a)) == BspTree::Changes{{a, rect(0, 0, 1000, 600)}}, "first window fills the area");
+	check(tree.insert(a).empty(), "inserting again changes nothing");
+
+	// Tiles are split along their longer axis, and only the split tile's window moves.
+	check(
+		sorted(tree.insert(b, a)) == BspTree::Changes{{a, rect(0, 0, 500, 600)}, {b, rect(500, 0, 1000, 600)}},
+		"wide tile split side by side"
+	);
+	check(
+		sorted(tree.insert(c, b)) == BspTree::Changes{{b, rect(500, 0, 1000, 300)}, {c, rect(500, 300, 1000, 600)}},
+		"tall tile split on top of each other"
+	);
+	check(
+		sorted(tree.insert(d, a)) == BspTree::Changes{{a, rect(0, 0, 500, 300)}, {d, rect(0, 300, 500, 600)}},
+		"other tile split"
+	);
+
+	// Without a known split target, the last tile is split.
+	check(
+		sorted(tree.insert(e, (HWND)99)) ==
+			BspTree::Changes{{c, rect(500, 300, 750, 600)}, {e, rect(750, 300, 1000, 600)}},
+		"last tile split"
+	);
+
+	// Resizing only moves the window and its sibling subtree.
+	check(
+		sorted(tree.set_ratio(b, 0.25f)) ==
+			BspTree::Changes{
+				{b, rect(500, 0,   1000, 150)},
+				{c, rect(500, 150, 750,  600)},
+				{e, rect(750, 150, 1000, 600)},
+			},
+		"resized split"
+	);
+	check(
+		sorted(tree.set_ratio(e, 0.75f)) ==
+			BspTree::Changes{{c, rect(500, 150, 625, 600)}, {e, rect(625, 150, 1000, 600)}},
+		"resized nested split"
+	);
+
+	// The sibling takes over the space of a removed window. Nothing else moves.
+	check(sorted(tree.remove(c)) == BspTree::Changes{{e, rect(500, 150, 1000, 600)}}, "sibling window takes over");
+	check(
+		sorted(tree.remove(b)) == BspTree::Changes{{e, rect(500, 0, 1000, 600)}}, "sibling window takes over whole side"
+	);
+	check(tree.remove(b).empty(), "removing again changes nothing");
+
+	check(tree.size() == 3 && tree.contains(a) && tree.contains(d) && tree.contains(e), "remaining windows");
+	check(tree.rect_of(a) == rect(0, 0, 500, 300) && tree.rect_of(d) == rect(0, 300, 500, 600), "remaining tiles");
+
+	// Swapping exchanges tiles and moves just the two windows.
+	check(sorted(tree.swap(a, e)) == BspTree::Changes{{a, rect(500, 0, 1000, 600)}, {e, rect(0, 0, 500, 300)}}, "swap");
+
+	// A new work area moves every window whose tile changes, keeping the ratios of the splits.
+	check(
+		sorted(tree.set_work_area(rect(0, 0, 1000, 800))) ==
+			BspTree::Changes{
+				{a, rect(500, 0,   1000, 800)},
+				{d, rect(0,   400, 500,  800)},
+				{e, rect(0,   0,   500,  400)},
+			},
+		"taller work area"
+	);
+	check(tree.set_work_area(rect(0, 0, 1000, 800)).empty(), "same work area changes nothing");
+
+	check(sorted(tree.remove(e)) == BspTree::Changes{{d, rect(0, 0, 500, 800)}}, "sibling window takes over");
+	check(sorted(tree.remove(d)) == BspTree::Changes{{a, rect(0, 0, 1000, 800)}}, "last window fills the area");
+	check(tree.remove(a).empty() && tree.empty(), "last window removed");
+
+	// The same through a desktop: opening and closing windows only moves the windows whose tiles change.
+	reset(0);
+	cfg.enable_tiling = true;
+
+	size_t n_batches = sim->position_batches().size();
+	auto sorted_batches = [&]() {
+		auto batches = new_position_batches(n_batches);
+		for (auto& batch : batches) {
+			sort(batch.begin(), batch.end());
+		}
+
+		return batches;
+	};
+
+	Rect area = sim->primary_work_area();
+	HWND first = sim->create_window("First", rect(100, 100, 200, 200));
+	sim->activate_window(first);
+	Desktop::update_all();
+	check(sorted_batches() == vector<vector<HWND>>{{first}}, "first window tiled");
+	check(sim->window_frame_bounds(first) == area, "first window fills the work area");
+
+	HWND second = sim->create_window("Second", rect(100, 100, 200, 200));
+	Desktop::update_all();
+	check(sorted_batches() == vector<vector<HWND>>{{first, second}}, "focused window split");
+
+	HWND third = sim->create_window("Third", rect(100, 100, 200, 200));
+	Desktop::update_all();
+	check(sorted_batches() == vector<vector<HWND>>{{first, third}}, "second window not moved");
+
+	sim->destroy_window(third);
+	Desktop::update_all();
+	check(sorted_batches() == vector<vector<HWND>>{{first}}, "only the sibling of the closed window moved");
+	float middle = round((area.top_left.x + area.bottom_right.x) / 2);
+	check(
+		sim->window_frame_bounds(first) == Rect{area.top_left, {middle, area.bottom_right.y}},
+		"sibling took over the space"
+	);
+}
+
+bool is_on_desktop_of_simulation(HWND handle) {
+	auto* desktop = Desktop::get(handle);
+	if (!desktop || !equal_to<GUID>{}(desktop->id(), *sim->window_desktop_id(handle))) {
+		return false;
+	}
+
+	// And on no other desktop
+	return all_of(Desktop::all().begin(), Desktop::all().end(), [&](auto& item) {
+		return &item.second == desktop || !item.second.get_window(handle);
+	});
+}
+
+// With cached desktop IDs, windows that were moved between desktops must still end up on the right one: the cache
+// only learns about such moves through window events. And with desktop switch notifications, the current desktop
+// must follow every switch, even to desktops without windows.
+void test_desktop_ids() {
+	for (size_t n_desktops : {1, 4, 24}) {
+		auto handles = reset(100, n_desktops);
+
+		set_desktop_id_caching(true);
+		auto window_events = platform().create_window_event_source();
+		Desktop::update_all();
+
+		GUID current = sim->current_desktop();
+		for (size_t i = 0; i < handles.size(); i += 7) {
+			// Windows are dealt out in turn, so the next one is on the next desktop.
+			GUID from = *sim->window_desktop_id(handles[i]);
+			GUID to = *sim->window_desktop_id(handles[(i + 1) % handles.size()]);
+
+			// Only moves from or to the current desktop are visible as (un)cloaking, just like on Windows.
+			if (equal_to<GUID>{}(from, current) != equal_to<GUID>{}(to, current)) {
+				sim->move_window_to_desktop(handles[i], to);
+			}
+		}
+
+		// Window events alone must get the windows to their new desktops.
+		apply_window_events(window_events.get());
+		for (HWND h : handles) {
+			check(is_on_desktop_of_simulation(h), "window on its desktop after move events");
+		}
+
+		Desktop::update_all();
+		for (HWND h : handles) {
+			check(is_on_desktop_of_simulation(h), "window on its desktop after moves");
+		}
+
+		// As must destroying windows get them off their desktops.
+		for (size_t i = 0; i < handles.size(); i += 11) {
+			sim->destroy_window(handles[i]);
+		}
+
+		apply_window_events(window_events.get());
+		for (size_t i = 0; i < handles.size(); ++i) {
+			check(i % 11 == 0 ? !Desktop::get(handles[i]) : is_on_desktop_of_simulation(handles[i]), "destroyed");
+		}
+
+		erase_if(handles, [&](HWND h) { return !sim->is_window(h); });
+
+		auto desktop_switches = platform().create_desktop_switch_source();
+		{
+			EventLoop loop;
+			track_current_desktop(loop, desktop_switches.get());
+
+			GUID first = *sim->window_desktop_id(handles.front()), last = *sim->window_desktop_id(handles.back());
+			for (GUID id : {last, sim->create_desktop(), first}) {
+				if (equal_to<GUID>{}(id, sim->current_desktop())) {
+					continue;
+				}
+
+				// Switching signals the source, so this does not block.
+				sim->switch_desktop(id);
+				tick(loop, window_events.get());
+				check(Desktop::current() && equal_to<GUID>{}(Desktop::current()->id(), id), "current desktop tracked");
+			}
+
+			track_current_desktop(loop, nullptr);
+		}
+
+		desktop_switches = nullptr;
+		window_events = nullptr;
+		set_desktop_id_caching(false);
+	}
+}
+
+// After switching desktops, once through the shell's desktop manager and once through its keyboard shortcuts,
+// twm's idea of the current desktop and of the focused window must match the simulation's, and the focused
+// window must be on the current desktop.
+void test_desktop_switch() {
+	for (bool direct : {true, false}) {
+		reset(100, 4);
+		sim->set_desktop_manager_available(direct);
+
+		vector<Command> commands = {
+			parse_command("focus desktop right"),
+			parse_command("focus desktop right"),
+			parse_command("focus desktop left"),
+			parse_command("focus desktop right"),
+			parse_command("focus desktop right"),
+			parse_command("focus desktop left"),
+			parse_command("focus desktop left"),
+			parse_command("focus desktop left"),
+		};
+
+		// Desktops can only be focused by index through the desktop manager.
+		if (direct) {
+			commands.emplace_back(parse_command("focus desktop 3"));
+			commands.emplace_back(parse_command("focus desktop 1"));
+			commands.emplace_back(parse_command("focus desktop 9"));
+		}
+
+		for (const auto& command : commands) {
+			invoke_action(command);
+
+			HWND foreground = sim->foreground_window();
+			auto* focused = Window::focused();
+			auto* current = Desktop::current();
+			check(current && equal_to<GUID>{}(current->id(), sim->current_desktop()), "current desktop");
+			check(
+				foreground && (focused ? focused->handle() : nullptr) == foreground &&
+					equal_to<GUID>{}(*sim->window_desktop_id(foreground), sim->current_desktop()),
+				"focused window on the current desktop"
+			);
+		}
+	}
+}
+
+// The window that a hotkey focuses stops responding. Hotkeys must keep being served regardless: the first one gives
+// up on the hung call after the timeout, later ones fail right away.
+void test_hung_window() {
+	reset(100);
+	cfg.hotkeys.add("alt-l", "focus window right");
+	int id = cfg.hotkeys.hotkeys().back().id;
+
+	Window* target = Window::focused() ? Window::focused()->get_adjacent(Direction::Right) : nullptr;
+	if (!check(target, "window to the right")) {
+		return;
+	}
+
+	HWND hung = target->handle();
+	auto timeout = chrono::milliseconds{50};
+	set_window_call_timeout(timeout);
+	sim->set_window_hung(hung, true);
+
+	auto window_events = platform().create_window_event_source();
+	EventLoop loop;
+	for (size_t i = 0; i < 100; ++i) {
+		auto start = clock::now();
+		sim->post_hotkey(id);
+		tick(loop, window_events.get());
+		check(clock::now() - start < 2 * timeout, "hotkey served within twice the timeout");
+	}
+
+	// The stuck call must return before the simulation goes away.
+	sim->set_window_hung(hung, false);
+	while (!is_window_responsive(hung)) {
+		this_thread::sleep_for(chrono::milliseconds{1});
+	}
+
+	set_window_call_timeout(cfg.window_call_timeout());
+}
+
+// More windows hang at once than the pool that calls them has workers. Calls to the windows that still respond must
+// keep being served, focusing included, and a border color that was skipped while a window was hung must be applied
+// once it responds again.
+void test_hung_windows() {
+	const size_t N_HUNG = 12;
+
+	reset(N_HUNG + 1);
+	auto handles = enumerate_windows();
+	if (!check(handles.size() == N_HUNG + 1, "all windows enumerated")) {
+		return;
+	}
+
+	HWND responsive = handles.back();
+	handles.pop_back();
+
+	auto timeout = chrono::milliseconds{50};
+	set_window_call_timeout(timeout);
+	for (HWND hung : handles) {
+		sim->set_window_hung(hung, true);
+	}
+
+	for (HWND hung : handles) {
+		auto start = clock::now();
+		check(!focus_window(hung), "hung window not focused");
+		set_window_border_color(hung, 0x00ff00);
+		check(clock::now() - start < 2 * timeout, "hung window given up on within twice the timeout");
+	}
+
+	auto start = clock::now();
+	check(focus_window(responsive), "responsive window focused");
+	check(get_foreground_window() == responsive, "responsive window in the foreground");
+	check(set_window_rect(responsive, Rect{{0, 0}, {100, 100}}), "responsive window moved");
+	check(clock::now() - start < timeout, "responsive window served before the timeout");
+
+	for (HWND hung : handles) {
+		sim->set_window_hung(hung, false);
+	}
+
+	for (HWND hung : handles) {
+		while (!is_window_responsive(hung)) {
+			this_thread::sleep_for(chrono::milliseconds{1});
+		}
+
+		set_window_border_color(hung, 0x00ff00);
+		check(
+			sim->window_attribute(hung, WindowAttribute::BorderColor) == 0x00ff00u,
+			"border color applied once the window responds"
+		);
+	}
+
+	set_window_call_timeout(cfg.window_call_timeout());
+}
+
+// Reloading hotkeys of which a few changed since the last time: some are gone, some are new, and some trigger a
+// different action. Hotkeys that remain must keep their ID, those that are gone must not be found by theirs, and
+// what is registered with the system must match the hotkeys. Enough reloads for each slot's generation to wrap.
+void test_hotkey_reload() {
+	const size_t N_BINDINGS = 500;
+
+	reset(0);
+	auto all = make_hotkey_bindings(N_BINDINGS + 5);
+
+	vector<Binding> a{all.begin(), all.begin() + N_BINDINGS};
+	vector<Binding> b{all.begin() + 5, all.end()};
+	for (size_t i = 0; i < b.size(); i += 50) {
+		b[i].action = "focus window up";
+	}
+
+	auto ids = [](const Hotkeys& hotkeys) {
+		unordered_map<string, int> result;
+		for (const auto& hotkey : hotkeys.hotkeys()) {
+			result[hotkey.keycombo] = hotkey.id;
+		}
+
+		return result;
+	};
+
+	Hotkeys hotkeys;
+	hotkeys.set(a);
+	for (size_t i = 0; i < 200; ++i) {
+		const auto& bindings = i % 2 == 0 ? b : a;
+		auto prev_ids = ids(hotkeys);
+		hotkeys.set(bindings);
+
+		auto new_ids = ids(hotkeys);
+		for (const auto& [keycombo, id] : prev_ids) {
+			if (new_ids.contains(keycombo)) {
+				check(new_ids[keycombo] == id, "remaining hotkey keeps its ID");
+			} else {
+				check(hotkeys.find(id) == nullptr, "removed hotkey not found");
+			}
+		}
+
+		for (const auto& binding : bindings) {
+			auto* hotkey = hotkeys.find(new_ids[binding.keycombo]);
+			check(hotkey && hotkey->action == binding.action, "hotkey has its new action");
+		}
+
+		auto registered = sim->registered_hotkeys();
+		check(registered.size() == hotkeys.hotkeys().size(), "as many registered as there are hotkeys");
+		for (const auto& hotkey : hotkeys.hotkeys()) {
+			auto it = registered.find(hotkey.id);
+			check(
+				hotkey.id <= 0xBFFF && it != registered.end() && it->second == pair{hotkey.modifiers, hotkey.keycode},
+				"hotkey registered"
+			);
+		}
+	}
+
+	// Ends on `a`, to which the last bindings of `b` are new.
+	auto prev_ids = ids(hotkeys);
+	auto invalid = b;
+	invalid.push_back({"alt-xyz", "close window"});
+	bool threw = false;
+	try {
+		hotkeys.set(invalid);
+	} catch (const runtime_error&) {
+		threw = true;
+	}
+
+	check(threw && ids(hotkeys) == prev_ids, "invalid bindings change nothing");
+	check(sim->registered_hotkeys().size() == prev_ids.size(), "invalid bindings register nothing");
+
+	// Held by another application, whose IDs are its own
+	auto [modifiers, keycode] = parse_keycombo(b.back().keycombo);
+	sim->register_hotkey(0xC000, modifiers, keycode);
+	auto errors = hotkeys.set(b);
+	check(errors.size() == 1 && !ids(hotkeys).contains(b.back().keycombo), "taken keycombo left out");
+	check(hotkeys.hotkeys().size() == b.size() - 1, "other keycombos registered");
+	sim->unregister_hotkey(0xC000);
+}
+
+// Key sequences of three keys each, such as "alt-a b c", pressed through the simulated keyboard hook in a shuffled
+// order. Each must trigger its command exactly once, and the keys that belong to a sequence must not reach
+// applications, unlike modifiers.
+void test_key_sequences() {
+	const size_t N_BINDINGS = 1000;
+
+	reset(0);
+
+	auto [bindings, presses] = make_key_sequences(N_BINDINGS);
+
+	auto matcher = make_shared<KeyMatcher>(bindings, map<string, vector<Binding>>{});
+	InputEngine engine;
+	engine.set_matcher(matcher);
+
+	vector<size_t> order(N_BINDINGS);
+	for (size_t i = 0; i < N_BINDINGS; ++i) {
+		order[i] = i;
+	}
+
+	shuffle(order.begin(), order.end(), mt19937{(uint32_t)N_BINDINGS});
+
+	for (size_t i : order) {
+		for (const auto& key : presses[i]) {
+			bool modifier = key.keycode == VK_LMENU;
+			check(sim->simulate_key(key) != modifier, "only keys of the sequence swallowed");
+		}
+
+		size_t n_triggered = 0;
+		engine.drain([&](const Command& command, clock::time_point) {
+			auto expected = parse_command(bindings[i].action);
+			check(
+				command.action == expected.action && command.target == expected.target &&
+					command.direction == expected.direction,
+				"sequence triggers its command"
+			);
+
+			++n_triggered;
+		});
+
+		check(n_triggered == 1, "sequence triggers once");
+	}
+}
+
+// Matchers that are set while the hook resolves keys. A sequence that was begun must not be continued by a matcher
+// that was set in the meantime, even if it is the very same one as before, and each matcher must stay alive for as
+// long as the hook may be using it.
+void test_matcher_swap() {
+	reset(0);
+
+	const map<string, vector<Binding>> no_modes;
+	auto sequence = make_shared<KeyMatcher>(vector<Binding>{{"alt-a b", "close window"}}, no_modes);
+	auto other = make_shared<KeyMatcher>(vector<Binding>{{"alt-c d", "close window"}}, no_modes);
+	const vector<KeyInput> prefix = {{VK_LMENU, false}, {'A', false}, {'A', true}, {VK_LMENU, true}};
+	const vector<KeyInput> last = {{'B', false}, {'B', true}};
+
+	size_t n_triggered = 0;
+	auto count = [&](const Command&, clock::time_point) { ++n_triggered; };
+
+	InputEngine engine;
+	engine.set_matcher(sequence);
+	for (const auto& key : prefix) {
+		sim->simulate_key(key);
+	}
+
+	engine.set_matcher(other);
+	engine.set_matcher(sequence);
+	check(!sim->simulate_key(last[0]) && !sim->simulate_key(last[1]), "key after the swap reaches applications");
+	engine.drain(count);
+	check(n_triggered == 0, "sequence begun before the swap not continued");
+
+	// The hook's thread keeps pressing the sequence while each matcher is replaced by a copy, the only reference to
+	// which the engine holds.
+	atomic<bool> done = false;
+	thread hook{[&]() {
+		while (!done) {
+			for (const auto& key : prefix) {
+				engine.on_key(key);
+			}
+
+			for (const auto& key : last) {
+				engine.on_key(key);
+			}
+		}
+	}};
+
+	for (size_t i = 0; i < 1000; ++i) {
+		engine.set_matcher(make_shared<KeyMatcher>(*sequence));
+		engine.drain(count);
+	}
+
+	done = true;
+	hook.join();
+	engine.drain(count);
+
+	n_triggered = 0;
+	for (const auto& key : prefix) {
+		sim->simulate_key(key);
+	}
+
+	for (const auto& key : last) {
+		sim->simulate_key(key);
+	}
+
+	engine.drain(count);
+	check(n_triggered == 1, "sequence triggers after the swaps");
+}
+
+// An editor's save may write the config file several times in a row, all of which must result in a single reload.
+// Malformed files must not be loaded.
+void test_config_reload() {
+	reset(0);
+
+	auto dir = filesystem::temp_directory_path() / "twm_test";
+	filesystem::create_directories(dir);
+	auto path = dir / "twm.toml";
+
+	auto write = [&](string_view content) {
+		ofstream{path} << content;
+		sim->notify_directory_changed(dir);
+	};
+
+	write("update_interval_seconds = 0.1\n");
+
+	EventLoop loop;
+	ConfigWatcher watcher{loop, path};
+
+	// Runs long enough for any superfluous reloads to happen, too. Never blocks for longer than that, because the
+	// loop always has a task due by then.
+	auto settle = [&]() {
+		auto time = clock::now() + chrono::milliseconds{500};
+		loop.schedule(time, []() {});
+		while (clock::now() < time) {
+			tick(loop, nullptr);
+		}
+	};
+
+	for (size_t i = 0; i < 3; ++i) {
+		size_t n_reloads = watcher.n_reloads();
+
+		// Each write is noticed before the next one. The directory change signals it, so `tick` does not block.
+		for (size_t j = 0; j < 50; ++j) {
+			write(format("update_interval_seconds = 0.1\n# Write {}\n", j));
+			tick(loop, nullptr);
+		}
+
+		settle();
+		check(watcher.n_reloads() == n_reloads + 1, "one reload per burst of writes");
+	}
+
+	size_t n_reloads = watcher.n_reloads();
+	write("[[[");
+	settle();
+	check(watcher.n_reloads() == n_reloads, "malformed file not loaded");
+
+	// Files that parse, but contain an invalid binding, must not be loaded in part either.
+	const char* invalid_files[] = {
+		"update_interval_seconds = 0.5\n[hotkeys]\nalt-h = \"focus window left\"\nalt-xyz = \"close window\"\n",
+		"update_interval_seconds = 0.5\n[sequences]\n\"alt-a h\" = \"close window\"\n\"alt-a xyz\" = \"reload\"\n",
+	};
+
+	for (const char* content : invalid_files) {
+		write(content);
+		settle();
+		check(watcher.n_reloads() == n_reloads, "file with an invalid binding not loaded");
+		check(cfg.update_interval_seconds == 0.1f, "settings left alone");
+		check(cfg.hotkeys.hotkeys().empty() && !cfg.key_matcher, "bindings left alone");
+	}
+
+	filesystem::remove_all(dir);
+}
+
+// What the compile-time table promises (see `key_names_round_trip`), and the errors that keycombos get.
+void test_key_names() {
+	for (const auto& key : KEY_NAMES) {
+		check(find_key(key.name) == key.keycode, "name leads to its key");
+
+		// Names of modifiers are keys only on their own.
+		if (!find_modifier(key.name)) {
+			check(parse_keycombo(format("ctrl-{}", key.name)).second == key.keycode, "keycombo with the name");
+		}
+	}
+
+	check(parse_keycombo("Ctrl - Alt - F13") == pair{(UINT)(MOD_CONTROL | MOD_ALT), (UINT)0x7C}, "spaces and case");
+	check(parse_keycombo("alt-shift") == pair{(UINT)(MOD_ALT | MOD_SHIFT), (UINT)0}, "keycombo without key");
+
+	auto error = [](string_view keycombo) -> string {
+		try {
+			parse_keycombo(keycombo);
+		} catch (const runtime_error& e) {
+			return e.what();
+		}
+
+		return "";
+	};
+
+	check(error("alt-xyz") == "unknown key \"xyz\"", "unknown key named");
+	check(error("alt-a-b") == "more than one key: \"b\"", "second key named");
+	check(error("alt-f25") == "unknown key \"f25\"", "f25 does not exist");
+
+	// Out-of-date seeds are searched for anew while compiling, which may take more steps than compilers allow.
+	const auto& seeds = KEY_NAME_TABLE.seeds();
+	if (!check(seeds == KeyNameTable::SEEDS, "KeyNameTable::SEEDS up to date")) {
+		cerr << "  Replace KeyNameTable::SEEDS with:";
+		for (size_t i = 0; i < seeds.size(); ++i) {
+			cerr << format("{}{},", i % 16 == 0 ? "\n    " : " ", seeds[i]);
+		}
+
+		cerr << "\n";
+	}
+}
+
+const pair<const char*, void (*)()> TESTS[] = {
+	{"spatial_index",        test_spatial_index       },
+	{"geometry_transaction", test_geometry_transaction},
+	{"bsp",                  test_bsp                 },
+	{"desktop_ids",          test_desktop_ids         },
+	{"desktop_switch",       test_desktop_switch      },
+	{"hung_window",          test_hung_window         },
+	{"hung_windows",         test_hung_windows        },
+	{"hotkey_reload",        test_hotkey_reload       },
+	{"key_sequences",        test_key_sequences       },
+	{"matcher_swap",         test_matcher_swap        },
+	{"config_reload",        test_config_reload       },
+	{"key_names",            test_key_names           },
+};
+
+} // namespace
+
+int main(int argc, char** argv) {
+	for (int i = 1; i < argc; ++i) {
+		string arg = argv[i];
+		if (arg == "--filter" && i + 1 < argc) {
+			filter = argv[++i];
+		} else {
+			cerr << "Usage: twm_test [--filter <substring>]\n";
+			return 1;
+		}
+	}
+
+	// Tests provoke warnings on purpose, e.g. by hanging windows.
+	min_severity = Severity::Error;
+
+	size_t n_failed = 0;
+	for (const auto& [name, test] : TESTS) {
+		if (string{name}.find(filter) == string::npos) {
+			continue;
+		}
+
+		size_t n_failed_before = n_failed_checks;
+		try {
+			test();
+		} catch (const runtime_error& e) {
+			cerr << format("  threw: {}\n", e.what());
+			++n_failed_checks;
+		}
+
+		bool passed = n_failed_checks == n_failed_before;
+		cerr << format("{:<24} {}\n", name, passed ? "passed" : "FAILED");
+		if (!passed) {
+			++n_failed;
+		}
+	}
+
+	flush_log();
+	if (n_failed > 0) {
+		cerr << format("{} test(s) failed\n", n_failed);
+		return 1;
+	}
+
+	return 0;
+}
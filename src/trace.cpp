@@ -0,0 +1,167 @@
+// This file was developed by Thomas Müller <thomas94@gmx.net>.
+// It is published under the GPU GPLv3 license; see LICENSE.txt for details.
+
+#include <twm/common.h>
+#include <twm/trace.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <format>
+#include <fstream>
+#include <mutex>
+#include <vector>
+
+using namespace std;
+
+namespace twm {
+
+// Hotkey handling records on the order of ten spans, so this covers the last few hundred hotkeys.
+constexpr size_t TRACE_CAPACITY = 8192;
+
+struct TraceBuffer {
+	mutex event_mutex;
+	array<TraceEvent, TRACE_CAPACITY> events = {};
+
+	// Total number of events ever recorded. The oldest ones have been overwritten.
+	size_t n_recorded = 0;
+};
+
+TraceBuffer& trace_buffer() {
+	static TraceBuffer buffer;
+	return buffer;
+}
+
+uint32_t current_thread_index() {
+	static atomic<uint32_t> counter = 0;
+	thread_local uint32_t index = counter++;
+	return index;
+}
+
+void set_detail(TraceEvent& event, string_view detail) {
+	size_t n = std::min(detail.size(), sizeof(event.detail) - 1);
+	copy_n(detail.begin(), n, event.detail);
+	event.detail[n] = '\0';
+}
+
+string json_escape(string_view str) {
+	string result;
+	result.reserve(str.size());
+	for (char c : str) {
+		switch (c) {
+			case '"': result += "\\\""; break;
+			case '\\': result += "\\\\"; break;
+			case '\n': result += "\\n"; break;
+			case '\r': result += "\\r"; break;
+			case '\t': result += "\\t"; break;
+			default: {
+				if ((unsigned char)c < 0x20) {
+					result += format("\\u{:04x}", (unsigned)c);
+				} else {
+					result += c;
+				}
+			} break;
+		}
+	}
+
+	return result;
+}
+
+double to_us(clock::duration d) { return chrono::duration<double, micro>(d).count(); }
+
+void trace(const TraceEvent& event) {
+	auto& buffer = trace_buffer();
+	lock_guard lock{buffer.event_mutex};
+	buffer.events[buffer.n_recorded++ % TRACE_CAPACITY] = event;
+}
+
+void trace(const char* name, clock::time_point start, clock::time_point end, string_view detail) {
+	TraceEvent event = {};
+	event.name = name;
+	event.start = start;
+	event.duration = end - start;
+	event.thread = current_thread_index();
+	set_detail(event, detail);
+	trace(event);
+}
+
+TraceSpan::TraceSpan(const char* name, string_view detail) {
+	m_event.name = name;
+	m_event.thread = current_thread_index();
+	set_detail(m_event, detail);
+
+	// Last, such that the setup above is not part of the span.
+	m_event.start = clock::now();
+}
+
+TraceSpan::~TraceSpan() {
+	m_event.duration = clock::now() - m_event.start;
+	trace(m_event);
+}
+
+string trace_to_json() {
+	vector<TraceEvent> events;
+	{
+		auto& buffer = trace_buffer();
+		lock_guard lock{buffer.event_mutex};
+		size_t n = std::min(buffer.n_recorded, TRACE_CAPACITY);
+		events.reserve(n);
+		for (size_t i = buffer.n_recorded - n; i < buffer.n_recorded; ++i) {
+			events.emplace_back(buffer.events[i % TRACE_CAPACITY]);
+		}
+	}
+
+	// Events are recorded when they end, so nested spans come before their parents. Viewers expect start order,
+	// with parents before the children that start at the same time.
+	sort(events.begin(), events.end(), [](const TraceEvent& a, const TraceEvent& b) {
+		return a.start != b.start ? a.start < b.start : a.duration > b.duration;
+	});
+
+	string result = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	for (size_t i = 0; i < events.size(); ++i) {
+		const auto& e = events[i];
+		result += format(
+			"{{\"name\":\"{}\",\"cat\":\"twm\",\"ph\":\"X\",\"pid\":1,\"tid\":{},\"ts\":{:.3f},\"dur\":{:.3f},\"args\":{{\"detail\":\"{}\"}}}}{}\n",
+			json_escape(e.name),
+			e.thread,
+			to_us(e.start.time_since_epoch()),
+			to_us(e.duration),
+			json_escape(e.detail),
+			i + 1 < events.size() ? "," : ""
+		);
+	}
+
+	result += "]}\n";
+	return result;
+}
+
+filesystem::path& configured_trace_path() {
+	static filesystem::path path;
+	return path;
+}
+
+filesystem::path trace_path() {
+	if (!configured_trace_path().empty()) {
+		return configured_trace_path();
+	}
+
+	error_code ec;
+	auto dir = filesystem::temp_directory_path(ec);
+	return ec ? filesystem::path{"twm_trace.json"} : dir / "twm_trace.json";
+}
+
+void set_trace_path(const filesystem::path& path) { configured_trace_path() = path; }
+
+void save_trace(const filesystem::path& path) {
+	ofstream f{path, ios::binary};
+	if (!f) {
+		throw runtime_error{format("Failed to open {} for writing", path.string())};
+	}
+
+	f << trace_to_json();
+	if (!f) {
+		throw runtime_error{format("Failed to write trace to {}", path.string())};
+	}
+}
+
+} // namespace twm
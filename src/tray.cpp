@@ -5,8 +5,10 @@
 #include <twm/icon.h>
 #include <twm/logging.h>
 #include <twm/platform.h>
+#include <twm/trace.h>
 #include <twm/tray.h>
 
+#include <future>
 #include <string>
 
 using namespace std;
@@ -14,6 +16,52 @@ using namespace std;
 namespace twm {
 
 TrayPresence::TrayPresence(HINSTANCE instance) {
+	promise<DWORD> thread_id;
+	m_thread = thread{[this, instance, owner_thread_id = GetCurrentThreadId(), &thread_id]() {
+		// Creates the thread's message queue, such that the destructor can post WM_QUIT to it.
+		MSG msg;
+		PeekMessage(&msg, nullptr, WM_USER, WM_USER, PM_NOREMOVE);
+		thread_id.set_value(GetCurrentThreadId());
+
+		run(instance, owner_thread_id);
+	}};
+
+	m_thread_id = thread_id.get_future().get();
+}
+
+TrayPresence::~TrayPresence() {
+	m_stopping = true;
+	PostThreadMessage(m_thread_id, WM_QUIT, 0, 0);
+	m_thread.join();
+}
+
+void TrayPresence::run(HINSTANCE instance, DWORD owner_thread_id) {
+	auto start = clock::now();
+	try {
+		add_icon(instance);
+	} catch (const runtime_error& e) {
+		log_warning("Tray presence failed: {}", e.what());
+		remove_icon();
+		return;
+	}
+
+	trace("startup_tray", start, clock::now());
+
+	MSG msg;
+	while (GetMessage(&msg, nullptr, 0, 0) > 0) {
+		TranslateMessage(&msg);
+		DispatchMessage(&msg);
+	}
+
+	remove_icon();
+
+	// The menu's exit item quit this thread's message loop. Pass it on to the owner.
+	if (!m_stopping) {
+		PostThreadMessage(owner_thread_id, WM_QUIT, 0, 0);
+	}
+}
+
+void TrayPresence::add_icon(HINSTANCE instance) {
 	static const string class_name = "twm_tray_window";
 	static atomic<uint32_t> uid_counter = 0;
 	m_uid = uid_counter++;
@@ -63,21 +111,29 @@ TrayPresence::TrayPresence(HINSTANCE instance) {
 	if (!Shell_NotifyIcon(NIM_ADD, &nid)) {
 		throw runtime_error{"Failed to add tray icon"};
 	}
+
+	m_icon_added = true;
 }
 
-TrayPresence::~TrayPresence() {
-	NOTIFYICONDATA nid = {};
-	nid.cbSize = sizeof(NOTIFYICONDATA);
-	nid.hWnd = m_invisible_window;
-	nid.uID = m_uid;
+void TrayPresence::remove_icon() {
+	if (m_icon_added) {
+		NOTIFYICONDATA nid = {};
+		nid.cbSize = sizeof(NOTIFYICONDATA);
+		nid.hWnd = m_invisible_window;
+		nid.uID = m_uid;
 
-	if (!Shell_NotifyIcon(NIM_DELETE, &nid)) {
-		log_warning("Failed to remove tray icon");
+		if (!Shell_NotifyIcon(NIM_DELETE, &nid)) {
+			log_warning("Failed to remove tray icon");
+		}
+
+		m_icon_added = false;
 	}
 
-	if (!DestroyWindow(m_invisible_window)) {
+	if (m_invisible_window && !DestroyWindow(m_invisible_window)) {
 		log_warning("Failed to destroy invisible window: {}", last_error_string());
 	}
+
+	m_invisible_window = nullptr;
 }
 
 LRESULT CALLBACK TrayPresence::tray_window_proc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam) {
@@ -85,6 +141,7 @@ LRESULT CALLBACK TrayPresence::tray_window_proc(HWND hWnd, UINT message, WPARAM
 		IDM_EXIT,
 		IDM_AUTOSTART_ENABLE,
 		IDM_AUTOSTART_DISABLE,
+		IDM_SAVE_TRACE,
 	};
 
 	switch (message) {
@@ -101,6 +158,7 @@ LRESULT CALLBACK TrayPresence::tray_window_proc(HWND hWnd, UINT message, WPARAM
 					autostart ? IDM_AUTOSTART_DISABLE : IDM_AUTOSTART_ENABLE,
 					"Start with Windows"
 				);
+				InsertMenu(menu, (UINT)-1, MF_BYPOSITION | MF_STRING, IDM_SAVE_TRACE, "Save trace");
 				InsertMenu(menu, (UINT)-1, MF_BYPOSITION | MF_STRING, IDM_EXIT, "Exit");
 
 				POINT pt;
@@ -125,6 +183,15 @@ LRESULT CALLBACK TrayPresence::tray_window_proc(HWND hWnd, UINT message, WPARAM
 				case IDM_AUTOSTART_DISABLE: {
 					set_autostart_enabled(false);
 				} break;
+				case IDM_SAVE_TRACE: {
+					try {
+						auto path = trace_path();
+						save_trace(path);
+						log_info("Saved trace to {}", path.string());
+					} catch (const runtime_error& e) {
+						log_warning(e.what());
+					}
+				} break;
 				case IDM_EXIT: {
 					log_debug("Tray received IDM_EXIT. Exiting...");
 					PostQuitMessage(0);
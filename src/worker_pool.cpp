@@ -0,0 +1,91 @@
+// This file was developed by Thomas Müller <thomas94@gmx.net>.
+// It is published under the GPU GPLv3 license; see LICENSE.txt for details.
+
+#include <twm/worker_pool.h>
+
+#include <algorithm>
+
+using namespace std;
+
+namespace twm {
+
+WorkerPool::WorkerPool(size_t n_threads) : m_n_threads{n_threads} {
+	// Workers look at m_threads to decide whether to retire.
+	lock_guard lock{m_mutex};
+	for (size_t i = 0; i < n_threads; ++i) {
+		m_threads.emplace_back([this]() { work(); });
+	}
+}
+
+WorkerPool::~WorkerPool() {
+	vector<thread> threads;
+	{
+		lock_guard lock{m_mutex};
+		m_stopping = true;
+
+		// Workers that retire from now on leave joining them to us.
+		threads = std::move(m_threads);
+	}
+
+	m_cv.notify_all();
+	for (auto& thread : threads) {
+		thread.join();
+	}
+}
+
+void WorkerPool::push(function<void()> task) {
+	{
+		lock_guard lock{m_mutex};
+		m_tasks.emplace_back(std::move(task));
+	}
+
+	m_cv.notify_one();
+}
+
+void WorkerPool::replace_stuck_worker() {
+	lock_guard lock{m_mutex};
+	++m_n_stuck;
+	if (!m_stopping) {
+		m_threads.emplace_back([this]() { work(); });
+	}
+}
+
+void WorkerPool::unstick_worker() {
+	lock_guard lock{m_mutex};
+	--m_n_stuck;
+}
+
+void WorkerPool::work() {
+	while (true) {
+		function<void()> task;
+		{
+			unique_lock lock{m_mutex};
+
+			// A worker that was stuck and has since been replaced retires. So would any other worker that gets here
+			// first, which is just as good.
+			if (!m_stopping && m_threads.size() - m_n_stuck > m_n_threads) {
+				auto it = find_if(m_threads.begin(), m_threads.end(), [](const thread& t) {
+					return t.get_id() == this_thread::get_id();
+				});
+
+				if (it != m_threads.end()) {
+					it->detach();
+					m_threads.erase(it);
+					return;
+				}
+			}
+
+			m_cv.wait(lock, [this]() { return m_stopping || !m_tasks.empty(); });
+			if (m_tasks.empty()) {
+				return;
+			}
+
+			task = std::move(m_tasks.front());
+			m_tasks.pop_front();
+		}
+
+		task();
+	}
+}
+
+} // namespace twm